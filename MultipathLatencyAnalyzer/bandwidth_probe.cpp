@@ -0,0 +1,123 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#include "bandwidth_probe.h"
+#include "monotonic_clock.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+
+namespace multipath {
+
+double EstimateCapacity(std::span<const PathLatencyMeasure> pairs, size_t datagramSize, long long& validPairs)
+{
+    const auto bits = static_cast<double>(datagramSize * 8);
+
+    std::vector<double> rates;
+    for (size_t i = 0; i + 1 < pairs.size(); i += 2)
+    {
+        const auto& first = pairs[i];
+        const auto& second = pairs[i + 1];
+        if (first.m_echoTimestamp < 0 || second.m_echoTimestamp < 0 || first.m_receiveTimestamp < 0 || second.m_receiveTimestamp < 0)
+        {
+            continue;
+        }
+
+        const auto dispersion = second.m_echoTimestamp - first.m_echoTimestamp;
+        if (dispersion > 0)
+        {
+            rates.push_back(bits * c_nanoSecInSecond / dispersion);
+        }
+    }
+
+    validPairs = static_cast<long long>(rates.size());
+    if (rates.empty())
+    {
+        return 0.;
+    }
+
+    std::ranges::nth_element(rates, rates.begin() + static_cast<std::ptrdiff_t>(rates.size() / 2));
+    return rates[rates.size() / 2];
+}
+
+PacketTrainResult MeasurePacketTrain(std::span<const PathLatencyMeasure> train, size_t datagramSize)
+{
+    PacketTrainResult result;
+    const auto bits = static_cast<double>(datagramSize * 8);
+
+    long long firstSend = -1;
+    long long lastSend = -1;
+    long long firstEcho = -1;
+    long long lastEcho = -1;
+    for (const auto& measure : train)
+    {
+        if (measure.m_sendTimestamp >= 0)
+        {
+            result.m_sentDatagrams += 1;
+            firstSend = firstSend < 0 ? measure.m_sendTimestamp : firstSend;
+            lastSend = measure.m_sendTimestamp;
+        }
+        if (measure.m_receiveTimestamp >= 0 && measure.m_echoTimestamp >= 0)
+        {
+            result.m_receivedDatagrams += 1;
+            firstEcho = firstEcho < 0 ? measure.m_echoTimestamp : (std::min)(firstEcho, measure.m_echoTimestamp);
+            lastEcho = (std::max)(lastEcho, measure.m_echoTimestamp);
+        }
+    }
+
+    // The rate at which the datagrams after the first one arrived, over the time between the first and the last
+    if (result.m_sentDatagrams > 1 && lastSend > firstSend)
+    {
+        result.m_inputRate = (result.m_sentDatagrams - 1) * bits * c_nanoSecInSecond / (lastSend - firstSend);
+    }
+    if (result.m_receivedDatagrams > 1 && lastEcho > firstEcho)
+    {
+        result.m_outputRate = (result.m_receivedDatagrams - 1) * bits * c_nanoSecInSecond / (lastEcho - firstEcho);
+    }
+    return result;
+}
+
+double EstimateAvailableBandwidth(const std::vector<PacketTrainResult>& trains) noexcept
+{
+    double availableBandwidth = 0.;
+    for (const auto& train : trains)
+    {
+        if (train.m_inputRate <= 0. || train.m_outputRate < c_trainKeepUpRatio * train.m_inputRate)
+        {
+            break;
+        }
+        availableBandwidth = (std::max)(availableBandwidth, train.m_inputRate);
+    }
+    return availableBandwidth;
+}
+
+void PrintBandwidthEstimate(const char* interfaceName, const BandwidthEstimate& estimate)
+{
+    std::cout << std::setprecision(2) << std::fixed;
+
+    std::cout << '\n';
+    std::cout << "--- BANDWIDTH OF THE " << interfaceName << " INTERFACE ---\n";
+    std::cout << '\n';
+
+    std::cout << "Packet pairs measured: " << estimate.m_validPairs << " / " << estimate.m_sentPairs << '\n';
+    if (estimate.m_capacity <= 0.)
+    {
+        std::cout << "Bottleneck capacity: unknown (no pair came back with distinct server receive timestamps)\n";
+        return;
+    }
+    std::cout << "Bottleneck capacity: " << estimate.m_capacity / 1024 << " kbps\n";
+
+    std::cout << '\n';
+    for (const auto& train : estimate.m_trains)
+    {
+        std::cout << "Packet train sent at " << std::setw(12) << train.m_inputRate / 1024 << " kbps, received at " << std::setw(12)
+                  << train.m_outputRate / 1024 << " kbps (" << train.m_receivedDatagrams << " / " << train.m_sentDatagrams
+                  << " datagrams)\n";
+    }
+
+    std::cout << '\n';
+    std::cout << "Available bandwidth: " << estimate.m_availableBandwidth / 1024 << " kbps\n";
+}
+
+} // namespace multipath
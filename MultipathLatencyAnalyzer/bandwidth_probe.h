@@ -0,0 +1,62 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include "latencyStatistics.h"
+
+#include <span>
+#include <vector>
+
+namespace multipath {
+
+// Estimate the bandwidth of an interface from the dispersion of short bursts, measured with the receive timestamps
+// the server writes in each echo: back to back packet pairs give the bottleneck capacity, then packet trains paced at
+// increasing fractions of this capacity show up to which bitrate the path keeps up (the available bandwidth).
+struct BandwidthProbeSettings
+{
+    unsigned long m_pairCount = 16;
+    unsigned long m_trainLength = 32;
+
+    // The trains are paced at 1/m_trainCount, 2/m_trainCount... of the capacity
+    unsigned long m_trainCount = 8;
+
+    // Idle time after each pair and each train, so that the queues drain before the next one
+    long long m_pairSpacing = 5'000'000;   // Nanosec
+    long long m_trainSpacing = 20'000'000; // Nanosec
+};
+
+struct PacketTrainResult
+{
+    long long m_sentDatagrams = 0;
+    long long m_receivedDatagrams = 0;
+
+    // The bitrate at which the train was sent, and the bitrate at which it reached the server, 0 if unknown
+    double m_inputRate = 0.;  // Bit/s
+    double m_outputRate = 0.; // Bit/s
+};
+
+struct BandwidthEstimate
+{
+    long long m_sentPairs = 0;
+    long long m_validPairs = 0;
+    double m_capacity = 0.;           // Bit/s, 0 if no pair could be measured
+    double m_availableBandwidth = 0.; // Bit/s
+    std::vector<PacketTrainResult> m_trains;
+};
+
+// A train keeps up when it reaches the server at least at this fraction of its input rate
+constexpr double c_trainKeepUpRatio = 0.9;
+
+// The median of the bitrates measured by each pair: its size divided by the spacing of its two datagrams at the
+// server. Pairs with a lost or reordered datagram, or received in a single coalesced receive, are ignored.
+double EstimateCapacity(std::span<const PathLatencyMeasure> pairs, size_t datagramSize, long long& validPairs);
+
+PacketTrainResult MeasurePacketTrain(std::span<const PathLatencyMeasure> train, size_t datagramSize);
+
+// The highest input rate of the trains that kept up, stopping at the first one that did not
+double EstimateAvailableBandwidth(const std::vector<PacketTrainResult>& trains) noexcept;
+
+void PrintBandwidthEstimate(const char* interfaceName, const BandwidthEstimate& estimate);
+
+} // namespace multipath
@@ -0,0 +1,137 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#include "capacity_search.h"
+#include "latencyStatistics.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+
+namespace multipath {
+namespace {
+
+    double LossPercent(const CapacityTrial& trial) noexcept
+    {
+        return trial.m_sentDatagrams > 0 ? (trial.m_sentDatagrams - trial.m_receivedDatagrams) * 100. / trial.m_sentDatagrams : 100.;
+    }
+
+} // namespace
+
+unsigned long CapacitySearch::GetNextBitRate() const noexcept
+{
+    if (m_trials.empty())
+    {
+        return m_settings.m_minBitRate;
+    }
+    if (m_trials.size() >= c_maxTrials)
+    {
+        return 0;
+    }
+
+    const auto& last = m_trials.back();
+
+    if (m_settings.m_algorithm == CapacitySearchAlgorithm::Aimd)
+    {
+        if (last.m_passed)
+        {
+            // Keep confirming the maximum bitrate would not tell anything new
+            if (last.m_bitRate >= m_settings.m_maxBitRate)
+            {
+                return 0;
+            }
+            const auto increase = (std::max)((m_settings.m_maxBitRate - m_settings.m_minBitRate) / c_aimdIncreaseSteps, 1UL);
+            return (std::min)(last.m_bitRate + increase, m_settings.m_maxBitRate);
+        }
+
+        if (last.m_bitRate <= m_settings.m_minBitRate)
+        {
+            return 0;
+        }
+        return (std::max)(last.m_bitRate / 2, m_settings.m_minBitRate);
+    }
+
+    // Binary search: the minimum bitrate is tried first, then the maximum, then the middle of the remaining range
+    unsigned long highestPassed = 0;
+    unsigned long lowestFailed = 0;
+    for (const auto& trial : m_trials)
+    {
+        if (trial.m_passed)
+        {
+            highestPassed = (std::max)(highestPassed, trial.m_bitRate);
+        }
+        else if (lowestFailed == 0 || trial.m_bitRate < lowestFailed)
+        {
+            lowestFailed = trial.m_bitRate;
+        }
+    }
+
+    if (highestPassed == 0 || highestPassed >= m_settings.m_maxBitRate)
+    {
+        return 0;
+    }
+    if (lowestFailed == 0)
+    {
+        return m_settings.m_maxBitRate;
+    }
+    if (lowestFailed - highestPassed <= static_cast<unsigned long>(highestPassed * c_binaryResolution))
+    {
+        return 0;
+    }
+    return highestPassed + (lowestFailed - highestPassed) / 2;
+}
+
+const CapacityTrial& CapacitySearch::AddTrial(
+    unsigned long bitRate, long long sentDatagrams, long long receivedDatagrams, long long latency99)
+{
+    CapacityTrial trial;
+    trial.m_bitRate = bitRate;
+    trial.m_sentDatagrams = sentDatagrams;
+    trial.m_receivedDatagrams = receivedDatagrams;
+    trial.m_latency99 = latency99;
+    trial.m_passed = receivedDatagrams > 0 && LossPercent(trial) <= m_settings.m_maxLoss &&
+                     latency99 <= static_cast<long long>(m_settings.m_maxLatency) * 1'000'000;
+
+    return m_trials.emplace_back(trial);
+}
+
+unsigned long CapacitySearch::GetCapacity() const noexcept
+{
+    unsigned long capacity = 0;
+    for (const auto& trial : m_trials)
+    {
+        if (trial.m_passed)
+        {
+            capacity = (std::max)(capacity, trial.m_bitRate);
+        }
+    }
+    return capacity;
+}
+
+void PrintCapacitySearch(const char* interfaceName, const CapacitySearch& search)
+{
+    std::cout << std::setprecision(2) << std::fixed;
+
+    std::cout << '\n';
+    std::cout << "--- CAPACITY OF THE " << interfaceName << " INTERFACE ---\n";
+    std::cout << '\n';
+
+    for (const auto& trial : search.GetTrials())
+    {
+        std::cout << std::setw(10) << trial.m_bitRate / 1024 << " kbps: " << trial.m_sentDatagrams << " datagrams sent, "
+                  << LossPercent(trial) << "% lost, 99th percentile latency " << ConvertNanosToMillis(trial.m_latency99)
+                  << " ms -> " << (trial.m_passed ? "passed" : "failed") << '\n';
+    }
+
+    std::cout << '\n';
+    if (const auto capacity = search.GetCapacity(); capacity > 0)
+    {
+        std::cout << "Capacity: " << capacity / 1024 << " kbps\n";
+    }
+    else
+    {
+        std::cout << "Capacity: below the minimum bitrate of the search\n";
+    }
+}
+
+} // namespace multipath
@@ -0,0 +1,80 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace multipath {
+
+enum class CapacitySearchAlgorithm
+{
+    Binary, // bisect between the highest passing and the lowest failing bitrates
+    Aimd    // additive increase after a passing trial, multiplicative decrease after a failing one
+};
+
+struct CapacitySearchSettings
+{
+    CapacitySearchAlgorithm m_algorithm = CapacitySearchAlgorithm::Binary;
+
+    // The range of bitrates tried, in bits per second
+    unsigned long m_minBitRate = 1 * 1024 * 1024;
+    unsigned long m_maxBitRate = 100 * 1024 * 1024;
+
+    // The duration of each trial, in seconds
+    unsigned long m_trialDuration = 2;
+
+    // A trial passes when its loss and its 99th percentile latency stay within these budgets
+    unsigned long m_maxLoss = 1;     // Percent
+    unsigned long m_maxLatency = 50; // Millisec
+};
+
+// The outcome of sending at a given bitrate on one interface
+struct CapacityTrial
+{
+    unsigned long m_bitRate = 0;
+    long long m_sentDatagrams = 0;
+    long long m_receivedDatagrams = 0;
+    long long m_latency99 = 0; // Nanosec
+    bool m_passed = false;
+};
+
+// Chooses the bitrate of each trial from the outcome of the previous ones, for one interface
+class CapacitySearch
+{
+public:
+    static constexpr size_t c_maxTrials = 16;
+
+    explicit CapacitySearch(const CapacitySearchSettings& settings) noexcept : m_settings(settings)
+    {
+    }
+
+    // The bitrate of the next trial, or 0 once the search is over
+    [[nodiscard]] unsigned long GetNextBitRate() const noexcept;
+
+    // Judge a trial against the budgets and record it
+    const CapacityTrial& AddTrial(unsigned long bitRate, long long sentDatagrams, long long receivedDatagrams, long long latency99);
+
+    // The highest bitrate that passed, 0 if none did
+    [[nodiscard]] unsigned long GetCapacity() const noexcept;
+
+    [[nodiscard]] const std::vector<CapacityTrial>& GetTrials() const noexcept
+    {
+        return m_trials;
+    }
+
+private:
+    // The binary search stops when the bitrates passing and failing are closer than this ratio
+    static constexpr double c_binaryResolution = 0.05;
+
+    // The AIMD search increases the bitrate by this fraction of the range after each passing trial
+    static constexpr unsigned long c_aimdIncreaseSteps = 16;
+
+    CapacitySearchSettings m_settings;
+    std::vector<CapacityTrial> m_trials;
+};
+
+void PrintCapacitySearch(const char* interfaceName, const CapacitySearch& search);
+
+} // namespace multipath
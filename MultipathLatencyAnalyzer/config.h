@@ -1,12 +1,30 @@
 #pragma once
 
+#include "bandwidth_probe.h"
+#include "capacity_search.h"
+#include "datagram.h"
+#include "echo_mode.h"
+#include "path_predictor.h"
+#include "scenario.h"
 #include "sockaddr.h"
+#include "threadpool_timer.h"
+#include "traffic_class.h"
 
 #include <filesystem>
+#include <vector>
 // Copyright (c) Microsoft Corporation.
 // Licensed under the MIT License.
 
 namespace multipath {
+
+// How the client picks among the addresses a target name resolves to
+enum class AddressSelection
+{
+    First, // the first address returned by the resolver
+    Best,  // the address with the lowest handshake round-trip time, the addresses are probed at the same time
+    All    // every address, each measured as a separate target
+};
+
 struct Configuration
 {
     // these values make debugging much easier
@@ -26,12 +44,26 @@ struct Configuration
 
     static constexpr DWORD c_defaultSocketReceiveBufferSize = 1048576;
 
+    static constexpr unsigned long c_defaultLoadBitrate = 100 * 1024 * 1024; // 100 megabits per second
+
+    static constexpr unsigned long c_maxFlows = 4096;
+
     // the address on which to listen (server only)
     ctl::ctSockaddr m_listenAddress{};
 
+    // what the server sends back of each datagram (server only)
+    EchoMode m_echoMode = EchoMode::Full;
+
     // the target address to connect to (client only)
     ctl::ctSockaddr m_targetAddress{};
 
+    // the other targets measured at the same time as m_targetAddress, one flow each (client only)
+    std::vector<ctl::ctSockaddr> m_additionalTargetAddresses{};
+
+    // every address each target name resolved to, and how to pick the addresses to measure among them (client only)
+    std::vector<std::vector<ctl::ctSockaddr>> m_resolvedTargetAddresses{};
+    AddressSelection m_addressSelection = AddressSelection::First;
+
     // the port to use for connections
     unsigned short m_port = c_defaultPort;
 
@@ -50,7 +82,58 @@ struct Configuration
     // the file to output the results to (as csv)
     std::filesystem::path m_outputFile{};
 
+    // a file written with -output, to replay through multipath scheduling policies instead of measuring
+    std::filesystem::path m_replayFile{};
+
     // behavior for the secondary WLAN interface
     bool m_useSecondaryWlanInterface = true;
+
+    // use the calibrated invariant TSC rather than QPC to timestamp datagrams
+    bool m_useTscClock = false;
+
+    // use UDP receive offload (coalescing). Segmentation offload is no longer opt-in: the client sends use it whenever
+    // available, as it is the only way to batch the sends on Windows (the datagrams of a batch share their timestamp).
+    bool m_udpOffload = false;
+
+    // grow the socket buffers and the number of posted receives when the observed traffic requires it
+    bool m_autotune = false;
+
+    // what the send timer does when ticks are missed (client only)
+    TimerOverrunPolicy m_timerOverrunPolicy = TimerOverrunPolicy::Burst;
+
+    // the latencies, in milliseconds, within which datagrams are counted as on time (client only)
+    std::vector<unsigned long> m_deadlines{30, 50, 100};
+
+    // search the highest bitrate each interface sustains instead of running at a fixed bitrate (client only)
+    bool m_searchCapacity = false;
+    CapacitySearchSettings m_capacitySearch{};
+
+    // estimate the bandwidth of each interface with packet pairs and trains instead of streaming (client only)
+    bool m_probeBandwidth = false;
+    BandwidthProbeSettings m_bandwidthProbe{};
+
+    // run the phases of a scenario file one after the other on the same sockets, instead of a single run (client only)
+    std::filesystem::path m_scenarioFile{};
+    std::vector<ScenarioPhase> m_scenario{};
+
+    // saturate an interface with a bulk flow during the second half of the run (client only)
+    bool m_loadFlow = false;
+    bool m_loadSecondaryInterface = false;
+    unsigned long m_loadBitrate = c_defaultLoadBitrate;
+
+    // the WMM access categories the datagrams are marked with in turn, each on its own socket (client only)
+    std::vector<TrafficClass> m_trafficClasses{};
+
+    // the number of flows (source ports) the datagrams are spread over on each interface (client only)
+    unsigned long m_flows = 1;
+
+    // the ECN field of the datagrams sent, Not-ECT to disable ECN (client only)
+    EcnCodepoint m_ecnCodepoint = EcnCodepoint::NotEct;
+
+    // report the completion of each group of datagrams sent together, as an application frame (client only)
+    bool m_frameMetrics = false;
+
+    // the model used to predict the latency of each path (client only)
+    PredictorModel m_predictorModel = PredictorModel::Ewma;
 };
 } // namespace multipath
\ No newline at end of file
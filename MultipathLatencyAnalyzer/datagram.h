@@ -3,97 +3,153 @@
 
 #pragma once
 
-#include "time_utils.h"
-
+#include <algorithm>
 #include <array>
+#include <climits>
 #include <span>
+#include <vector>
 #include <WinSock2.h>
 
 namespace multipath {
 
 constexpr unsigned long c_datagramSequenceNumberLength = 8;
 constexpr unsigned long c_datagramTimestampLength = 8;
-constexpr unsigned long c_datagramHeaderLength = c_datagramSequenceNumberLength + 2 * c_datagramTimestampLength;
+constexpr unsigned long c_datagramEcnLength = 8;
+constexpr unsigned long c_datagramHeaderLength =
+    c_datagramSequenceNumberLength + 2 * c_datagramTimestampLength + c_datagramEcnLength;
+
+// The header before the ECN field was added. Datagrams this short are still valid, they just carry no ECN field: the
+// versions of the client and the server can be mixed.
+constexpr unsigned long c_datagramMinimumHeaderLength = c_datagramSequenceNumberLength + 2 * c_datagramTimestampLength;
+
+// The ECN field of the IP header (RFC 3168)
+enum class EcnCodepoint : int
+{
+    NotEct = 0,
+    Ect1 = 1,
+    Ect0 = 2,
+    Ce = 3
+};
+
+// The server could not read the ECN field of the datagram it echoed
+constexpr int c_unknownEcnCodepoint = -1;
 
 struct DatagramHeader
 {
     long long m_sequenceNumber;
-    long long m_sendTimestamp; // Microsec
-    long long m_echoTimestamp; // Microsec
+    long long m_sendTimestamp;    // Nanosec
+    long long m_echoTimestamp;    // Nanosec
+    long long m_echoEcnCodepoint; // The ECN field of the datagram received by the server, or c_unknownEcnCodepoint
 };
 
 static_assert(sizeof(DatagramHeader) == c_datagramHeaderLength);
 
-class DatagramSendRequest
-{
-private:
-    static constexpr int c_datagramSequenceNumberOffset = 0;
-    static constexpr int c_datagramSendTimestampOffset = 1;
-    static constexpr int c_datagramEchoTimestampOffset = 2;
-    static constexpr int c_datagramPayloadOffset = 3;
+// Sequence number of the datagrams of a load flow (see LoadFlow): the server does not echo them
+constexpr long long c_loadSequenceNumber = LLONG_MIN;
 
-public:
-    ~DatagramSendRequest() = default;
+// Size of the datagrams sent by the client
+constexpr size_t c_datagramMaxSize = 1024; // 1KB
 
-    DatagramSendRequest() = delete;
-    DatagramSendRequest(const DatagramSendRequest&) = delete;
-    DatagramSendRequest& operator=(const DatagramSendRequest&) = delete;
-    DatagramSendRequest(DatagramSendRequest&&) = delete;
-    DatagramSendRequest& operator=(DatagramSendRequest&&) = delete;
+// Only the fields of the minimum header can be accessed when the datagram is shorter than c_datagramHeaderLength
+inline DatagramHeader& ParseDatagramHeader(char* buffer) noexcept
+{
+    return *reinterpret_cast<DatagramHeader*>(buffer);
+}
 
-    static constexpr size_t c_bufferArraySize = 4;
-    using BufferArray = std::array<WSABUF, c_bufferArraySize>;
+inline bool HasEcnField(size_t datagramSize) noexcept
+{
+    return datagramSize >= c_datagramHeaderLength;
+}
 
-    DatagramSendRequest(long long sequenceNumber, std::span<const char> sendBuffer) : m_sequenceNumber(sequenceNumber)
-    {
-        static_assert(c_bufferArraySize == c_datagramPayloadOffset + 1);
+// A pre-formatted datagram: a header followed by a constant payload pattern.
+// Only the header fields change from one send to the next.
+struct DatagramSendBuffer
+{
+    std::array<char, c_datagramMaxSize> m_buffer{};
+    bool m_inFlight = false;
 
-        // buffer layout: sequence number, send timestamp, echo timestamp, then buffer data
-        m_wsabufs[c_datagramSequenceNumberOffset].buf = reinterpret_cast<char*>(&m_sequenceNumber);
-        m_wsabufs[c_datagramSequenceNumberOffset].len = c_datagramSequenceNumberLength;
+    DatagramHeader& GetHeader() noexcept
+    {
+        return ParseDatagramHeader(m_buffer.data());
+    }
+};
 
-        m_wsabufs[c_datagramSendTimestampOffset].buf = reinterpret_cast<char*>(&m_sendTimestamp);
-        m_wsabufs[c_datagramSendTimestampOffset].len = c_datagramTimestampLength;
+// A ring of pre-formatted datagrams.
+// A buffer is owned by the ring until it is acquired, and must stay untouched until the asynchronous send using it
+// completes and releases it: this guarantees the buffers outlive the send operations.
+// Not thread-safe: callers serialize access (MeasuredSocket uses its lock).
+class DatagramSendRing
+{
+public:
+    explicit DatagramSendRing(size_t capacity) : m_buffers(capacity)
+    {
+        for (auto& buffer : m_buffers)
+        {
+            for (size_t i = 0; i < buffer.m_buffer.size(); ++i)
+            {
+                buffer.m_buffer[i] = static_cast<char>(i);
+            }
+            buffer.GetHeader() = {0, 0, 0, c_unknownEcnCodepoint};
+        }
+    }
 
-        m_wsabufs[c_datagramEchoTimestampOffset].buf = reinterpret_cast<char*>(&m_echoTimestamp);
-        m_wsabufs[c_datagramEchoTimestampOffset].len = c_datagramTimestampLength;
+    ~DatagramSendRing() = default;
 
-        m_wsabufs[c_datagramPayloadOffset].buf = const_cast<char*>(sendBuffer.data());
-        m_wsabufs[c_datagramPayloadOffset].len = static_cast<ULONG>(sendBuffer.size() - c_datagramHeaderLength);
-    }
+    DatagramSendRing(const DatagramSendRing&) = delete;
+    DatagramSendRing& operator=(const DatagramSendRing&) = delete;
+    DatagramSendRing(DatagramSendRing&&) = delete;
+    DatagramSendRing& operator=(DatagramSendRing&&) = delete;
 
-    BufferArray& GetBuffers() noexcept
+    // Returns the next buffer with its sequence number set, or nullptr if all the buffers are still in flight.
+    // The send timestamp must be set by the caller at the last possible moment before sending.
+    DatagramSendBuffer* Acquire(long long sequenceNumber) noexcept
     {
-        // refresh QPC value at last possible moment
-        m_sendTimestamp = SnapQpcInMicroSec();
-        return m_wsabufs;
+        auto& buffer = m_buffers[m_next];
+        if (buffer.m_inFlight)
+        {
+            return nullptr;
+        }
+
+        m_next = (m_next + 1) % m_buffers.size();
+        buffer.m_inFlight = true;
+        buffer.GetHeader().m_sequenceNumber = sequenceNumber;
+        return &buffer;
     }
 
-    [[nodiscard]] long long GetQpc() const noexcept
+    static void Release(DatagramSendBuffer& buffer) noexcept
     {
-        return m_sendTimestamp;
+        buffer.m_inFlight = false;
     }
 
 private:
-    BufferArray m_wsabufs{};
-    long long m_sequenceNumber = 0;
-    long long m_sendTimestamp = 0;
-    long long m_echoTimestamp = 0;
+    std::vector<DatagramSendBuffer> m_buffers;
+    size_t m_next = 0;
 };
 
-inline bool ValidateBufferLength(size_t completedBytes) noexcept
+// Invoke the callback on each datagram of a receive buffer holding datagrams of datagramSize bytes coalesced by the
+// network stack (the last one may be shorter). A datagramSize of 0 means the buffer holds a single datagram.
+template <typename Callback>
+void ForEachCoalescedDatagram(std::span<char> buffer, size_t datagramSize, Callback&& callback)
 {
-    if (completedBytes < c_datagramHeaderLength)
+    if (datagramSize == 0)
     {
-        fprintf(stderr, "ValidateBufferLength rejecting the datagram: the size (%zu) is less than DatagramHeaderLength (%lu)", completedBytes, c_datagramHeaderLength);
-        return false;
+        datagramSize = buffer.size();
+    }
+
+    for (size_t offset = 0; offset < buffer.size(); offset += datagramSize)
+    {
+        callback(buffer.subspan(offset, (std::min)(datagramSize, buffer.size() - offset)));
     }
-    return true;
 }
 
-inline DatagramHeader& ParseDatagramHeader(char* buffer) noexcept
+inline bool ValidateBufferLength(size_t completedBytes) noexcept
 {
-    return *reinterpret_cast<DatagramHeader*>(buffer);
+    if (completedBytes < c_datagramMinimumHeaderLength)
+    {
+        fprintf(stderr, "ValidateBufferLength rejecting the datagram: the size (%zu) is less than DatagramMinimumHeaderLength (%lu)", completedBytes, c_datagramMinimumHeaderLength);
+        return false;
+    }
+    return true;
 }
 
 } // namespace multipath
\ No newline at end of file
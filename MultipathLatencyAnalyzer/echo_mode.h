@@ -0,0 +1,15 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+namespace multipath {
+
+// What the server sends back of each datagram
+enum class EchoMode
+{
+    Full,  // the whole datagram, loading the path back to the client as much as the path to the server
+    Header // only the header, with the echo fields: the path back to the client carries a fraction of the traffic
+};
+
+} // namespace multipath
@@ -0,0 +1,170 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#include "flow_statistics.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+
+namespace multipath {
+namespace {
+
+    struct FlowStatistics
+    {
+        const std::string* m_name = nullptr;
+        unsigned short m_port = 0;
+        long long m_sentDatagrams = 0;
+        long long m_receivedDatagrams = 0;
+        long long m_latencyMedian = 0; // Nanosec
+        long long m_latency99 = 0;     // Nanosec
+    };
+
+    long long GetPercentile(const std::vector<long long>& sortedLatencies, double percentile) noexcept
+    {
+        if (sortedLatencies.empty())
+        {
+            return 0;
+        }
+        const auto rank = static_cast<size_t>(static_cast<double>(sortedLatencies.size()) * percentile / 100);
+        return sortedLatencies[(std::min)(sortedLatencies.size() - 1, rank)];
+    }
+
+    double GetLossPercent(const FlowStatistics& stats) noexcept
+    {
+        const auto lostDatagrams = stats.m_sentDatagrams - stats.m_receivedDatagrams;
+        return stats.m_sentDatagrams > 0 ? static_cast<double>(lostDatagrams) * 100. / static_cast<double>(stats.m_sentDatagrams) : 0.;
+    }
+
+    // (sum x)^2 / (n * sum x^2): 1 when all the flows get the same share, 1/n when a single flow gets everything
+    double GetJainFairnessIndex(const std::vector<FlowStatistics>& flows) noexcept
+    {
+        double sum = 0;
+        double sumOfSquares = 0;
+        for (const auto& stats : flows)
+        {
+            const auto share = stats.m_sentDatagrams > 0
+                                   ? static_cast<double>(stats.m_receivedDatagrams) / static_cast<double>(stats.m_sentDatagrams)
+                                   : 0.;
+            sum += share;
+            sumOfSquares += share * share;
+        }
+        return sumOfSquares > 0 ? sum * sum / (static_cast<double>(flows.size()) * sumOfSquares) : 0.;
+    }
+
+    void PrintFlow(const FlowStatistics& stats)
+    {
+        std::cout << *stats.m_name << " (port " << stats.m_port << "): " << stats.m_sentDatagrams - stats.m_receivedDatagrams
+                  << " / " << stats.m_sentDatagrams << " datagrams lost (" << GetLossPercent(stats)
+                  << "%), latency (median / 99th percentile): " << ConvertNanosToMillis(stats.m_latencyMedian) << " ms / "
+                  << ConvertNanosToMillis(stats.m_latency99) << " ms\n";
+    }
+
+    // Min / median / max over the flows
+    template <typename Projection>
+    void PrintSpread(const char* name, const char* unit, std::vector<FlowStatistics> flows, Projection projection)
+    {
+        std::ranges::sort(flows, {}, projection);
+        std::cout << name << " (min / median / max over the flows): " << projection(flows.front()) << unit << " / "
+                  << projection(flows[flows.size() / 2]) << unit << " / " << projection(flows.back()) << unit << '\n';
+    }
+
+    void PrintPathFlowStatistics(
+        const PathLatencyData& path, const char* pathName, const std::vector<FlowDescription>& descriptions, unsigned short FlowDescription::*port)
+    {
+        const auto flowCount = descriptions.size();
+        std::vector<std::vector<long long>> latencies(flowCount);
+        std::vector<FlowStatistics> flows(flowCount);
+        for (size_t s = 0; s < path.m_latencies.size(); ++s)
+        {
+            const auto& stat = path.m_latencies[s];
+            if (stat.m_sendTimestamp < 0)
+            {
+                continue;
+            }
+            auto& stats = flows[s % flowCount];
+            stats.m_sentDatagrams += 1;
+            if (stat.m_receiveTimestamp >= 0)
+            {
+                stats.m_receivedDatagrams += 1;
+                latencies[s % flowCount].push_back(stat.m_receiveTimestamp - stat.m_sendTimestamp);
+            }
+        }
+
+        for (size_t f = 0; f < flowCount; ++f)
+        {
+            std::ranges::sort(latencies[f]);
+            flows[f].m_name = &descriptions[f].m_name;
+            flows[f].m_port = descriptions[f].*port;
+            flows[f].m_latencyMedian = GetPercentile(latencies[f], 50);
+            flows[f].m_latency99 = GetPercentile(latencies[f], 99);
+        }
+
+        // Only the flows that sent on this interface
+        std::erase_if(flows, [](const auto& stats) { return stats.m_sentDatagrams == 0; });
+        if (flows.empty())
+        {
+            return;
+        }
+
+        std::cout << '\n';
+        std::cout << flows.size() << " flows on " << pathName << '\n';
+        PrintSpread("Loss", "%", flows, GetLossPercent);
+
+        // A flow without any echo has no latency
+        auto receivingFlows = flows;
+        std::erase_if(receivingFlows, [](const auto& stats) { return stats.m_receivedDatagrams == 0; });
+        if (!receivingFlows.empty())
+        {
+            PrintSpread("Median latency", " ms", receivingFlows, [](const FlowStatistics& stats) {
+                return ConvertNanosToMillis(stats.m_latencyMedian);
+            });
+            PrintSpread("99th percentile latency", " ms", receivingFlows, [](const FlowStatistics& stats) {
+                return ConvertNanosToMillis(stats.m_latency99);
+            });
+        }
+        std::cout << "Jain's fairness index of the datagrams delivered to each flow: " << GetJainFairnessIndex(flows) << '\n';
+
+        if (flows.size() <= c_maxDetailedFlows)
+        {
+            for (const auto& stats : flows)
+            {
+                PrintFlow(stats);
+            }
+            return;
+        }
+
+        const auto worstCount = (std::min)(c_worstFlowsDisplayed, flows.size());
+        std::ranges::partial_sort(flows, flows.begin() + static_cast<std::ptrdiff_t>(worstCount), std::ranges::greater{}, GetLossPercent);
+        std::cout << "Flows with the highest loss:\n";
+        for (size_t i = 0; i < worstCount; ++i)
+        {
+            PrintFlow(flows[i]);
+        }
+        std::ranges::partial_sort(
+            flows, flows.begin() + static_cast<std::ptrdiff_t>(worstCount), std::ranges::greater{}, &FlowStatistics::m_latency99);
+        std::cout << "Flows with the highest 99th percentile latency:\n";
+        for (size_t i = 0; i < worstCount; ++i)
+        {
+            PrintFlow(flows[i]);
+        }
+    }
+
+} // namespace
+
+void PrintFlowStatistics(const LatencyData& data, const std::vector<FlowDescription>& flows)
+{
+    if (flows.size() <= 1)
+    {
+        return;
+    }
+
+    std::cout << std::setprecision(2) << std::fixed;
+
+    std::cout << '\n';
+    std::cout << "--- FLOWS ---\n";
+    PrintPathFlowStatistics(data.m_primary, "primary interface", flows, &FlowDescription::m_primaryPort);
+    PrintPathFlowStatistics(data.m_secondary, "secondary interface", flows, &FlowDescription::m_secondaryPort);
+}
+
+} // namespace multipath
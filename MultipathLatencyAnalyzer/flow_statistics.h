@@ -0,0 +1,31 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include "latencyStatistics.h"
+
+#include <string>
+#include <vector>
+
+namespace multipath {
+
+// The name of a flow in the statistics, and its local (source) port on each interface, 0 when the flow was not setup
+// on the interface
+struct FlowDescription
+{
+    std::string m_name;
+    unsigned short m_primaryPort = 0;
+    unsigned short m_secondaryPort = 0;
+};
+
+// Every flow is printed up to this number of flows, above it only the distribution over the flows and the worst flows
+constexpr size_t c_maxDetailedFlows = 16;
+constexpr size_t c_worstFlowsDisplayed = 5;
+
+// The datagrams are spread over the flows in turn: the datagram with sequence number s belongs to flows[s % flows.size()].
+// Prints, for each interface, the losses and the latency percentiles of each flow, their spread over the flows and the
+// Jain's fairness index of the datagrams delivered to each flow.
+void PrintFlowStatistics(const LatencyData& data, const std::vector<FlowDescription>& flows);
+
+} // namespace multipath
@@ -0,0 +1,164 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#include "frame_tracker.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <numeric>
+
+namespace multipath {
+
+void FrameTracker::Initialize(long long datagramCount, long long frameSize)
+{
+    m_frameSize = frameSize;
+    m_datagramCount = datagramCount;
+    m_frameCount = static_cast<size_t>((datagramCount + frameSize - 1) / frameSize);
+    m_wordsPerFrame = static_cast<size_t>((frameSize + 63) / 64);
+
+    // Atomics are neither copyable nor movable: build the vectors in place
+    for (auto& path : m_paths)
+    {
+        path.m_bitmaps = std::vector<std::atomic<uint64_t>>(m_frameCount * m_wordsPerFrame);
+        path.m_receivedDatagrams = std::vector<std::atomic<long long>>(m_frameCount);
+        path.m_completionTimestamps.assign(m_frameCount, -1);
+    }
+
+    m_combinedBitmaps = std::vector<std::atomic<uint64_t>>(m_frameCount * m_wordsPerFrame);
+    m_combinedReceivedDatagrams = std::vector<std::atomic<long long>>(m_frameCount);
+    m_combinedCompletionTimestamps.assign(m_frameCount, -1);
+}
+
+long long FrameTracker::GetFrameSize(size_t frame) const noexcept
+{
+    // The last frame may be shorter
+    return (std::min)(m_frameSize, m_datagramCount - static_cast<long long>(frame) * m_frameSize);
+}
+
+void FrameTracker::OnReceived(size_t path, long long sequenceNumber, long long receiveTimestamp) noexcept
+{
+    if (sequenceNumber < 0 || sequenceNumber >= m_datagramCount)
+    {
+        return;
+    }
+
+    const auto frame = static_cast<size_t>(sequenceNumber / m_frameSize);
+    const auto index = sequenceNumber % m_frameSize;
+    const auto word = frame * m_wordsPerFrame + static_cast<size_t>(index / 64);
+    const auto bit = uint64_t{1} << (index % 64);
+    const auto frameSize = GetFrameSize(frame);
+
+    auto& pathFrames = m_paths[path];
+    if ((pathFrames.m_bitmaps[word].fetch_or(bit) & bit) != 0)
+    {
+        return;
+    }
+    if (pathFrames.m_receivedDatagrams[frame].fetch_add(1) + 1 == frameSize)
+    {
+        pathFrames.m_completionTimestamps[frame] = receiveTimestamp;
+    }
+
+    // Only the first reception on any path counts for the combined paths
+    if ((m_combinedBitmaps[word].fetch_or(bit) & bit) != 0)
+    {
+        return;
+    }
+    if (m_combinedReceivedDatagrams[frame].fetch_add(1) + 1 == frameSize)
+    {
+        m_combinedCompletionTimestamps[frame] = receiveTimestamp;
+    }
+}
+
+void FrameTracker::PrintStatistics(const LatencyData& data) const
+{
+    if (!IsEnabled())
+    {
+        return;
+    }
+
+    // A frame starts when its first datagram is sent, on any path
+    std::vector<long long> frameSendTimestamps(m_frameCount, std::numeric_limits<long long>::max());
+    for (const auto* latencies : {&data.m_primary.m_latencies, &data.m_secondary.m_latencies})
+    {
+        for (size_t i = 0; i < latencies->size() && static_cast<long long>(i) < m_datagramCount; ++i)
+        {
+            const auto sendTimestamp = (*latencies)[i].m_sendTimestamp;
+            auto& frameSendTimestamp = frameSendTimestamps[i / static_cast<size_t>(m_frameSize)];
+            if (sendTimestamp >= 0)
+            {
+                frameSendTimestamp = (std::min)(frameSendTimestamp, sendTimestamp);
+            }
+        }
+    }
+
+    auto completionLatencies = [&](const std::vector<long long>& completionTimestamps) {
+        std::vector<long long> latencies;
+        for (size_t frame = 0; frame < m_frameCount; ++frame)
+        {
+            if (completionTimestamps[frame] >= 0)
+            {
+                latencies.push_back(completionTimestamps[frame] - frameSendTimestamps[frame]);
+            }
+        }
+        std::ranges::sort(latencies);
+        return latencies;
+    };
+
+    const auto primaryLatencies = completionLatencies(m_paths[0].m_completionTimestamps);
+    const auto secondaryLatencies = completionLatencies(m_paths[1].m_completionTimestamps);
+    const auto combinedLatencies = completionLatencies(m_combinedCompletionTimestamps);
+
+    long long sentFrames = 0;
+    long long framesRescuedBySecondary = 0;
+    for (size_t frame = 0; frame < m_frameCount; ++frame)
+    {
+        sentFrames += frameSendTimestamps[frame] != std::numeric_limits<long long>::max() ? 1 : 0;
+        framesRescuedBySecondary += m_combinedCompletionTimestamps[frame] >= 0 && m_paths[0].m_completionTimestamps[frame] < 0 ? 1 : 0;
+    }
+
+    const auto combinedCompleteFrames = static_cast<long long>(combinedLatencies.size());
+    const auto lostFrames = sentFrames - combinedCompleteFrames;
+
+    auto percent = [](auto a, auto b) { return b > 0 ? a * 100. / b : 0.; };
+    auto percentile = [](const std::vector<long long>& latencies, double p) {
+        if (latencies.empty())
+        {
+            return 0LL;
+        }
+        return latencies[(std::min)(latencies.size() - 1, static_cast<size_t>(p / 100. * latencies.size()))];
+    };
+    auto printLatencies = [&](const char* name, const std::vector<long long>& latencies) {
+        const auto average = latencies.empty()
+                                 ? 0LL
+                                 : std::accumulate(latencies.begin(), latencies.end(), 0LL) / static_cast<long long>(latencies.size());
+        std::cout << "Frame completion latency on " << name << " (average / median / 99th percentile): "
+                  << ConvertNanosToMillis(average) << " ms / " << ConvertNanosToMillis(percentile(latencies, 50)) << " ms / "
+                  << ConvertNanosToMillis(percentile(latencies, 99)) << " ms\n";
+    };
+
+    std::cout << std::setprecision(2) << std::fixed;
+
+    std::cout << '\n';
+    std::cout << "--- FRAMES ---\n";
+    std::cout << '\n';
+    std::cout << sentFrames << " frames of " << m_frameSize << " datagrams were sent.\n";
+    std::cout << "Complete frames on primary interface: " << primaryLatencies.size() << " ("
+              << percent(static_cast<long long>(primaryLatencies.size()), sentFrames) << "%)\n";
+    std::cout << "Complete frames on secondary interface: " << secondaryLatencies.size() << " ("
+              << percent(static_cast<long long>(secondaryLatencies.size()), sentFrames) << "%)\n";
+    std::cout << "Complete frames on combined interfaces: " << combinedCompleteFrames << " ("
+              << percent(combinedCompleteFrames, sentFrames) << "%)\n";
+    std::cout << "Lost frames (incomplete on combined interfaces): " << lostFrames << " (" << percent(lostFrames, sentFrames)
+              << "%)\n";
+    std::cout << "Frames completed thanks to the secondary interface (incomplete on primary interface): "
+              << framesRescuedBySecondary << " (" << percent(framesRescuedBySecondary, sentFrames) << "%)\n";
+
+    std::cout << '\n';
+    printLatencies("primary interface", primaryLatencies);
+    printLatencies("secondary interface", secondaryLatencies);
+    printLatencies("combined interfaces", combinedLatencies);
+}
+
+} // namespace multipath
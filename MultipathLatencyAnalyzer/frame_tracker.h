@@ -0,0 +1,72 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include "latencyStatistics.h"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+namespace multipath {
+
+// Tracks the datagrams sent during each timer tick as an application frame (a video frame for instance).
+// A frame is complete on a path when all its datagrams were received on that path, and complete on the combined
+// paths when each of its datagrams was received on any path.
+class FrameTracker
+{
+public:
+    static constexpr size_t c_pathCount = 2;
+
+    FrameTracker() = default;
+    ~FrameTracker() = default;
+
+    FrameTracker(const FrameTracker&) = delete;
+    FrameTracker& operator=(const FrameTracker&) = delete;
+    FrameTracker(FrameTracker&&) = delete;
+    FrameTracker& operator=(FrameTracker&&) = delete;
+
+    // Track datagramCount datagrams, by frames of frameSize consecutive sequence numbers. Must be called before any
+    // datagram is received.
+    void Initialize(long long datagramCount, long long frameSize);
+
+    [[nodiscard]] bool IsEnabled() const noexcept
+    {
+        return m_frameSize > 0;
+    }
+
+    // Record the reception of a datagram on a path. Can be called concurrently, including for the same path: the
+    // sockets of the traffic classes, the flows or the targets of a path complete each under their own lock.
+    void OnReceived(size_t path, long long sequenceNumber, long long receiveTimestamp) noexcept;
+
+    // Must be called once no more datagram can be received
+    void PrintStatistics(const LatencyData& data) const;
+
+private:
+    // Updated concurrently by the completions of the sockets of the path
+    struct PathFrames
+    {
+        std::vector<std::atomic<uint64_t>> m_bitmaps;
+        std::vector<std::atomic<long long>> m_receivedDatagrams;
+        // Nanosec, -1 while the frame is incomplete, written by the completion finishing the frame
+        std::vector<long long> m_completionTimestamps;
+    };
+
+    [[nodiscard]] long long GetFrameSize(size_t frame) const noexcept;
+
+    long long m_frameSize = 0;
+    long long m_datagramCount = 0;
+    size_t m_frameCount = 0;
+    size_t m_wordsPerFrame = 0;
+
+    std::array<PathFrames, c_pathCount> m_paths{};
+
+    // The combined paths, updated concurrently by the completions of each path
+    std::vector<std::atomic<uint64_t>> m_combinedBitmaps;
+    std::vector<std::atomic<long long>> m_combinedReceivedDatagrams;
+    std::vector<long long> m_combinedCompletionTimestamps; // Nanosec, written by the completion finishing the frame
+};
+
+} // namespace multipath
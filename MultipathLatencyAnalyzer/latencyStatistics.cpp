@@ -4,27 +4,21 @@
 #include "latencyStatistics.h"
 
 #include <algorithm>
+#include <array>
+#include <charconv>
 #include <functional>
 #include <iostream>
 #include <iomanip>
 #include <limits>
 #include <numeric>
 #include <ranges>
+#include <stdexcept>
+#include <string>
 #include <vector>
 #include <cmath>
 
 namespace multipath {
 
-constexpr double ConvertMicrosToMillis(long long micros) noexcept
-{
-    return micros / 1'000.;
-}
-
-constexpr double ConvertMicrosToSeconds(long long micros)
-{
-    return micros / 1'000'000.;
-}
-
 template <std::ranges::range R, class T>
 [[nodiscard]] constexpr T accumulate(R&& range, T val)
 {
@@ -51,7 +45,147 @@ auto to_vector(R&& r, size_t sizeHint = 0)
     return v;
 }
 
-void PrintLatencyStatistics(LatencyData& data)
+std::vector<LatencyMeasure> JoinLatencyMeasures(const LatencyData& data)
+{
+    const auto& primary = data.m_primary.m_latencies;
+    const auto& secondary = data.m_secondary.m_latencies;
+
+    std::vector<LatencyMeasure> latencies(std::max(primary.size(), secondary.size()));
+    for (size_t i = 0; i < primary.size(); ++i)
+    {
+        latencies[i].m_primarySendTimestamp = primary[i].m_sendTimestamp;
+        latencies[i].m_primaryEchoTimestamp = primary[i].m_echoTimestamp;
+        latencies[i].m_primaryReceiveTimestamp = primary[i].m_receiveTimestamp;
+        latencies[i].m_primaryEcnCodepoint = primary[i].m_echoEcnCodepoint;
+    }
+    for (size_t i = 0; i < secondary.size(); ++i)
+    {
+        latencies[i].m_secondarySendTimestamp = secondary[i].m_sendTimestamp;
+        latencies[i].m_secondaryEchoTimestamp = secondary[i].m_echoTimestamp;
+        latencies[i].m_secondaryReceiveTimestamp = secondary[i].m_receiveTimestamp;
+        latencies[i].m_secondaryEcnCodepoint = secondary[i].m_echoEcnCodepoint;
+    }
+
+    return latencies;
+}
+
+namespace {
+
+    // On-time delivery for one deadline, computed in a single pass over the datagrams.
+    // The goodput counts the bits received within the deadline, per second of the run (by send time).
+    struct DeadlineStatistics
+    {
+        std::array<long long, 3> m_onTimeDatagrams{};
+        std::array<std::vector<long long>, 3> m_onTimeGoodput{}; // bits per second
+    };
+
+    constexpr size_t c_primaryPath = 0;
+    constexpr size_t c_secondaryPath = 1;
+    constexpr size_t c_effectivePath = 2;
+
+    void PrintDeadlineStatistics(
+        const std::vector<LatencyMeasure>& latencies,
+        size_t datagramSize,
+        const std::vector<unsigned long>& deadlines,
+        const std::array<long long, 3>& sentDatagrams)
+    {
+        if (deadlines.empty() || latencies.empty())
+        {
+            return;
+        }
+
+        auto firstSend = std::numeric_limits<long long>::max();
+        for (const auto& stat : latencies)
+        {
+            for (const auto sendTimestamp : {stat.m_primarySendTimestamp, stat.m_secondarySendTimestamp})
+            {
+                if (sendTimestamp >= 0)
+                {
+                    firstSend = std::min(firstSend, sendTimestamp);
+                }
+            }
+        }
+
+        std::vector<DeadlineStatistics> statistics(deadlines.size());
+        auto countOnTime = [&](size_t path, long long send, long long receive) {
+            if (send < 0 || receive < 0)
+            {
+                return;
+            }
+
+            const auto latency = receive - send;
+            const auto second = static_cast<size_t>((send - firstSend) / 1'000'000'000);
+            for (size_t i = 0; i < deadlines.size(); ++i)
+            {
+                if (latency <= static_cast<long long>(deadlines[i]) * 1'000'000)
+                {
+                    auto& goodput = statistics[i].m_onTimeGoodput[path];
+                    if (goodput.size() <= second)
+                    {
+                        goodput.resize(second + 1);
+                    }
+                    goodput[second] += static_cast<long long>(datagramSize) * 8;
+                    statistics[i].m_onTimeDatagrams[path] += 1;
+                }
+            }
+        };
+
+        for (const auto& stat : latencies)
+        {
+            countOnTime(c_primaryPath, stat.m_primarySendTimestamp, stat.m_primaryReceiveTimestamp);
+            countOnTime(c_secondaryPath, stat.m_secondarySendTimestamp, stat.m_secondaryReceiveTimestamp);
+
+            // The effective path: from the first send to the first receive, on any interface
+            auto first = [](long long a, long long b) { return a >= 0 && b >= 0 ? std::min(a, b) : std::max(a, b); };
+            countOnTime(
+                c_effectivePath,
+                first(stat.m_primarySendTimestamp, stat.m_secondarySendTimestamp),
+                first(stat.m_primaryReceiveTimestamp, stat.m_secondaryReceiveTimestamp));
+        }
+
+        // Every second of the run counts, even those without any datagram on time
+        size_t runSeconds = 0;
+        for (const auto& deadline : statistics)
+        {
+            for (const auto& goodput : deadline.m_onTimeGoodput)
+            {
+                runSeconds = std::max(runSeconds, goodput.size());
+            }
+        }
+
+        auto percent = [](auto a, auto b) { return b > 0 ? a * 100. / b : 0.; };
+        constexpr std::array<const char*, 3> pathNames{"primary interface", "secondary interface", "combined interfaces"};
+
+        std::cout << '\n';
+        std::cout << "--- DEADLINES ---\n";
+        for (size_t i = 0; i < deadlines.size(); ++i)
+        {
+            std::cout << '\n';
+            for (size_t path = 0; path < pathNames.size(); ++path)
+            {
+                std::cout << "Datagrams received within " << deadlines[i] << " ms on " << pathNames[path] << ": "
+                          << statistics[i].m_onTimeDatagrams[path] << " ("
+                          << percent(statistics[i].m_onTimeDatagrams[path], sentDatagrams[path]) << "%)\n";
+            }
+
+            for (size_t path = 0; path < pathNames.size(); ++path)
+            {
+                auto goodput = statistics[i].m_onTimeGoodput[path];
+                goodput.resize(runSeconds);
+                std::ranges::sort(goodput);
+                const auto average = goodput.empty() ? 0LL : accumulate(goodput, 0LL) / static_cast<long long>(goodput.size());
+                const auto minimum = goodput.empty() ? 0LL : goodput.front();
+                const auto median = goodput.empty() ? 0LL : goodput[goodput.size() / 2];
+                std::cout << "Goodput within " << deadlines[i] << " ms on " << pathNames[path]
+                          << " (minimum / median / average per second): " << minimum / 1024 << " / " << median / 1024
+                          << " / " << average / 1024 << " kb/s\n";
+            }
+        }
+    }
+
+} // namespace
+
+void PrintLatencyStatistics(LatencyData& data, const std::vector<unsigned long>& deadlines)
 {
     using namespace std::views;
 
@@ -100,6 +234,9 @@ void PrintLatencyStatistics(LatencyData& data)
     auto average = [](auto& data) { return data.size() > 0 ? accumulate(data, 0LL) / data.size() : 0LL; };
     auto percent = [](auto a, auto b) { return b > 0 ? a * 100. / b : 0.; };
     auto median = [](const auto& data) { return data.size() > 0 ? data[data.size() / 2] : 0LL; };
+    // On sorted data. A path may receive nothing: a scenario phase sending on one interface, or losing everything
+    auto minimum = [](const auto& data) { return data.size() > 0 ? data.front() : 0LL; };
+    auto maximum = [](const auto& data) { return data.size() > 0 ? data.back() : 0LL; };
     auto interquartileRange = [](const auto& data) {
         const auto s = data.size();
         return s > 0 ? data[3 * s / 4] - data[s / 4] : 0LL;
@@ -111,15 +248,17 @@ void PrintLatencyStatistics(LatencyData& data)
             return 0LL;
         }
 
-        auto r = 0LL;
+        // accumulate in floating point: squared nanosecond latencies overflow 64 bits over long runs
+        auto r = 0.;
         for (const auto& d: data)
         {
-            r += d * d;
+            r += static_cast<double>(d) * static_cast<double>(d);
         }
-        return static_cast<long long>(std::sqrt(r / data.size() - average * average));
+        const auto mean = static_cast<double>(average);
+        return static_cast<long long>(std::sqrt(std::max(r / data.size() - mean * mean, 0.)));
     };
 
-    const auto& latencies = data.m_latencies;
+    const auto latencies = JoinLatencyMeasures(data);
 
     // Compute latencies on primary, secondary or both simultaneously
     auto primaryLatencies =
@@ -155,7 +294,8 @@ void PrintLatencyStatistics(LatencyData& data)
 
     const auto secondaryTimeSave = std::max(sumPrimaryLatencies - sumEffectiveLatencies, 0LL);
     auto effectiveTimestamps = latencies | transform(selectEffective) | filter(received);
-    const auto runDuration = ConvertMicrosToSeconds(effectiveTimestamps.back().first - effectiveTimestamps.front().first);
+    const auto runDuration =
+        effectiveTimestamps.empty() ? 0. : ConvertNanosToSeconds(effectiveTimestamps.back().first - effectiveTimestamps.front().first);
     const auto byteTransfered = aggregatedSentDatagrams * data.m_datagramSize / 1024;
     const auto bitRate = runDuration > 0 ? byteTransfered * 8 / runDuration : 0;
 
@@ -176,7 +316,7 @@ void PrintLatencyStatistics(LatencyData& data)
               << bitRate << " kb/s.\n";
     std::cout << '\n';
     std::cout << "The secondary interface prevented " << primaryLostDatagrams - aggregatedLostDatagrams << " lost datagrams.\n";
-    std::cout << "The secondary interface reduced the overall time waiting for datagrams by " << ConvertMicrosToMillis(secondaryTimeSave)
+    std::cout << "The secondary interface reduced the overall time waiting for datagrams by " << ConvertNanosToMillis(secondaryTimeSave)
               << " ms (" << percent(secondaryTimeSave, sumPrimaryLatencies) << "%).\n";
     std::cout << receivedOnSecondaryFirst << " datagrams were received first on the secondary interface ("
               << percent(receivedOnSecondaryFirst, aggregatedReceivedDatagrams) << "%).\n";
@@ -186,6 +326,8 @@ void PrintLatencyStatistics(LatencyData& data)
     std::cout << '\n';
     std::cout << "Sent datagrams on primary interface: " << primarySentDatagrams << '\n';
     std::cout << "Sent datagrams on secondary interface: " << secondarySentDatagrams << '\n';
+    std::cout << "Datagrams not sent, all the send buffers being in flight, on primary / secondary interface: "
+              << data.m_primary.m_sendRingDrops << " / " << data.m_secondary.m_sendRingDrops << '\n';
 
     std::cout << '\n';
     std::cout << "Received datagrams on primary interface: " << primaryReceivedDatagrams << " ("
@@ -200,6 +342,20 @@ void PrintLatencyStatistics(LatencyData& data)
               << percent(secondaryLostDatagrams, secondarySentDatagrams) << "%)\n";
     std::cout << "Lost datagrams on both interface simultaneously: " << aggregatedLostDatagrams << " ("
               << percent(aggregatedLostDatagrams, aggregatedSentDatagrams) << "%)\n";
+    std::cout << "Lost datagrams received late (after the end-of-run drain) on primary / secondary interface: "
+              << data.m_primary.m_lateDatagrams << " / " << data.m_secondary.m_lateDatagrams << '\n';
+
+    // The host counter covers all the UDP sockets: it is an upper bound of the losses caused by our receive queues
+    const long long lostDatagrams = primaryLostDatagrams + secondaryLostDatagrams;
+    const long long hostLostDatagrams = std::min(data.m_hostReceiveDrops, lostDatagrams);
+    const long long networkLostDatagrams = lostDatagrams - hostLostDatagrams;
+
+    std::cout << '\n';
+    std::cout << "Datagrams dropped by the client host UDP receive queues: " << data.m_hostReceiveDrops << '\n';
+    std::cout << "Lost datagrams attributed to host receive queue overflow: " << hostLostDatagrams << " ("
+              << percent(hostLostDatagrams, lostDatagrams) << "%)\n";
+    std::cout << "Lost datagrams attributed to the network (in-network or at the server): " << networkLostDatagrams << " ("
+              << percent(networkLostDatagrams, lostDatagrams) << "%)\n";
 
     // Average latency
     const long long primaryAverageLatency = average(primaryLatencies);
@@ -207,9 +363,9 @@ void PrintLatencyStatistics(LatencyData& data)
     const long long effectiveAverageLatency = average(effectiveLatencies);
 
     std::cout << '\n';
-    std::cout << "Average latency on primary interface: " << ConvertMicrosToMillis(primaryAverageLatency) << " ms\n";
-    std::cout << "Average latency on secondary interface: " << ConvertMicrosToMillis(secondaryAverageLatency) << " ms\n";
-    std::cout << "Average effective latency on combined interface: " << ConvertMicrosToMillis(effectiveAverageLatency)
+    std::cout << "Average latency on primary interface: " << ConvertNanosToMillis(primaryAverageLatency) << " ms\n";
+    std::cout << "Average latency on secondary interface: " << ConvertNanosToMillis(secondaryAverageLatency) << " ms\n";
+    std::cout << "Average effective latency on combined interface: " << ConvertNanosToMillis(effectiveAverageLatency)
               << " ms (" << percent(primaryAverageLatency - effectiveAverageLatency, primaryAverageLatency)
               << "% improvement over primary) \n";
 
@@ -218,10 +374,10 @@ void PrintLatencyStatistics(LatencyData& data)
     const auto secondaryStandardDeviation = standardDeviation(secondaryLatencies, secondaryAverageLatency);
     const auto effectiveStandardDeviation = standardDeviation(effectiveLatencies, effectiveAverageLatency);
     std::cout << '\n';
-    std::cout << "Jitter (standard deviation) on primary interface: " << ConvertMicrosToMillis(primaryStandardDeviation) << " ms\n";
-    std::cout << "Jitter (standard deviation) on secondary interface: " << ConvertMicrosToMillis(secondaryStandardDeviation)
+    std::cout << "Jitter (standard deviation) on primary interface: " << ConvertNanosToMillis(primaryStandardDeviation) << " ms\n";
+    std::cout << "Jitter (standard deviation) on secondary interface: " << ConvertNanosToMillis(secondaryStandardDeviation)
               << " ms\n";
-    std::cout << "Jitter (standard deviation) on combined interfaces: " << ConvertMicrosToMillis(effectiveStandardDeviation)
+    std::cout << "Jitter (standard deviation) on combined interfaces: " << ConvertNanosToMillis(effectiveStandardDeviation)
               << " ms\n";
 
     // Median latency
@@ -230,9 +386,9 @@ void PrintLatencyStatistics(LatencyData& data)
     const auto effectiveMedianLatency = median(effectiveLatencies);
 
     std::cout << '\n';
-    std::cout << "Median latency on primary interface: " << ConvertMicrosToMillis(primaryMedianLatency) << " ms\n";
-    std::cout << "Median latency on secondary interface: " << ConvertMicrosToMillis(secondaryMedianLatency) << " ms\n";
-    std::cout << "Median effective latency on combined interfaces: " << ConvertMicrosToMillis(effectiveMedianLatency)
+    std::cout << "Median latency on primary interface: " << ConvertNanosToMillis(primaryMedianLatency) << " ms\n";
+    std::cout << "Median latency on secondary interface: " << ConvertNanosToMillis(secondaryMedianLatency) << " ms\n";
+    std::cout << "Median effective latency on combined interfaces: " << ConvertNanosToMillis(effectiveMedianLatency)
               << " ms (" << percent(primaryMedianLatency - effectiveMedianLatency, primaryMedianLatency)
               << "% improvement over primary) \n";
 
@@ -242,41 +398,157 @@ void PrintLatencyStatistics(LatencyData& data)
     const auto effectiveIrqLatency = interquartileRange(effectiveLatencies);
 
     std::cout << '\n';
-    std::cout << "Interquartile range on primary interface: " << ConvertMicrosToMillis(primaryIrqLatency) << " ms\n";
-    std::cout << "Interquartile range on secondary interface: " << ConvertMicrosToMillis(secondaryIrqLatency) << " ms\n";
-    std::cout << "Interquartile range latency on combined interfaces: " << ConvertMicrosToMillis(effectiveIrqLatency) << " ms\n";
+    std::cout << "Interquartile range on primary interface: " << ConvertNanosToMillis(primaryIrqLatency) << " ms\n";
+    std::cout << "Interquartile range on secondary interface: " << ConvertNanosToMillis(secondaryIrqLatency) << " ms\n";
+    std::cout << "Interquartile range latency on combined interfaces: " << ConvertNanosToMillis(effectiveIrqLatency) << " ms\n";
 
     // Minimum and maximum latency
-    const auto primaryMinimumLatency = std::ranges::min(primaryLatencies);
-    const auto primaryMaximumLatency = std::ranges::max(primaryLatencies);
-    const auto secondaryMinimumLatency = std::ranges::min(secondaryLatencies);
-    const auto secondaryMaximumLatency = std::ranges::max(secondaryLatencies);
+    const auto primaryMinimumLatency = minimum(primaryLatencies);
+    const auto primaryMaximumLatency = maximum(primaryLatencies);
+    const auto secondaryMinimumLatency = minimum(secondaryLatencies);
+    const auto secondaryMaximumLatency = maximum(secondaryLatencies);
+    std::cout << '\n';
+    std::cout << "Minimum / Maximum latency on primary interface: " << ConvertNanosToMillis(primaryMinimumLatency)
+              << " ms / " << ConvertNanosToMillis(primaryMaximumLatency) << " ms\n";
+    std::cout << "Minimum / Maximum latency on secondary interface: " << ConvertNanosToMillis(secondaryMinimumLatency)
+              << " ms / " << ConvertNanosToMillis(secondaryMaximumLatency) << " ms\n";
+
     std::cout << '\n';
-    std::cout << "Minimum / Maximum latency on primary interface: " << ConvertMicrosToMillis(primaryMinimumLatency)
-              << " ms / " << ConvertMicrosToMillis(primaryMaximumLatency) << " ms\n";
-    std::cout << "Minimum / Maximum latency on secondary interface: " << ConvertMicrosToMillis(secondaryMinimumLatency)
-              << " ms / " << ConvertMicrosToMillis(secondaryMaximumLatency) << " ms\n";
+    std::cout << "Corrupt datagrams on primary interface: " << data.m_primary.m_corruptDatagrams << '\n';
+    std::cout << "Corrupt datagrams on secondary interface: " << data.m_secondary.m_corruptDatagrams << '\n';
 
     std::cout << '\n';
-    std::cout << "Corrupt datagrams on primary interface: " << data.m_primaryCorruptDatagrams << '\n';
-    std::cout << "Corrupt datagrams on secondary interface: " << data.m_secondaryCorruptDatagrams << '\n';
+    std::cout << "Socket buffer size / posted receives on primary interface: " << data.m_primary.m_socketBufferSize / 1024
+              << " kB / " << data.m_primary.m_receiveDepth << '\n';
+    std::cout << "Socket buffer size / posted receives on secondary interface: " << data.m_secondary.m_socketBufferSize / 1024
+              << " kB / " << data.m_secondary.m_receiveDepth << '\n';
+
+    std::cout << '\n';
+    std::cout << "Latency prediction error (median / 99th / 99.9th percentile) on primary interface: "
+              << ConvertNanosToMillis(data.m_primary.m_predictionErrorMedian) << " ms / "
+              << ConvertNanosToMillis(data.m_primary.m_predictionError99) << " ms / "
+              << ConvertNanosToMillis(data.m_primary.m_predictionError999) << " ms\n";
+    std::cout << "Latency prediction error (median / 99th / 99.9th percentile) on secondary interface: "
+              << ConvertNanosToMillis(data.m_secondary.m_predictionErrorMedian) << " ms / "
+              << ConvertNanosToMillis(data.m_secondary.m_predictionError99) << " ms / "
+              << ConvertNanosToMillis(data.m_secondary.m_predictionError999) << " ms\n";
+
+    // A late sender distorts the measures as much as the network does
+    std::cout << '\n';
+    std::cout << "Send timer ticks: " << data.m_timerTicks << '\n';
+    std::cout << "Send timer ticks run after the next tick was due: " << data.m_lateTimerTicks << " ("
+              << percent(data.m_lateTimerTicks, data.m_timerTicks) << "%)\n";
+    std::cout << "Send timer ticks skipped: " << data.m_skippedTimerTicks << '\n';
+    std::cout << "Send timer tick lateness (median / 99th / 99.9th percentile / maximum): "
+              << ConvertNanosToMillis(data.m_timerLatenessMedian) << " ms / " << ConvertNanosToMillis(data.m_timerLateness99)
+              << " ms / " << ConvertNanosToMillis(data.m_timerLateness999) << " ms / "
+              << ConvertNanosToMillis(data.m_timerLatenessMaximum) << " ms\n";
+
+    PrintDeadlineStatistics(
+        latencies, data.m_datagramSize, deadlines, {primarySentDatagrams, secondarySentDatagrams, aggregatedSentDatagrams});
 }
 
 void DumpLatencyData(const LatencyData& data, std::ofstream& file)
 {
     // Add column header
-    file << "Sequence number, Primary Send timestamp (microsec), Primary Echo timestamp (microsec), Primary Receive "
-            "timestamp (microsec), "
-         << "Secondary Send timestamp (microsec), Secondary Echo timestamp (microsec), Secondary Receive timestamp (microsec)\n";
+    file << "Sequence number, Primary Send timestamp (nanosec), Primary Echo timestamp (nanosec), Primary Receive "
+            "timestamp (nanosec), "
+         << "Secondary Send timestamp (nanosec), Secondary Echo timestamp (nanosec), Secondary Receive timestamp (nanosec), "
+         << "Primary ECN codepoint, Secondary ECN codepoint\n";
     // Add raw timestamp data
-    for (std::size_t i = 0; i < data.m_latencies.size(); ++i)
+    const auto latencies = JoinLatencyMeasures(data);
+    for (std::size_t i = 0; i < latencies.size(); ++i)
     {
-        const auto& stat = data.m_latencies[i];
+        const auto& stat = latencies[i];
         file << i << ", ";
         file << stat.m_primarySendTimestamp << ", " << stat.m_primaryEchoTimestamp << ", " << stat.m_primaryReceiveTimestamp << ", ";
-        file << stat.m_secondarySendTimestamp << ", " << stat.m_secondaryEchoTimestamp << ", " << stat.m_secondaryReceiveTimestamp;
+        file << stat.m_secondarySendTimestamp << ", " << stat.m_secondaryEchoTimestamp << ", " << stat.m_secondaryReceiveTimestamp << ", ";
+        file << stat.m_primaryEcnCodepoint << ", " << stat.m_secondaryEcnCodepoint;
         file << "\n";
     }
 }
 
+void PrintEcnStatistics(const LatencyData& data)
+{
+    // Not-ECT, ECT(1), ECT(0), CE, then unknown
+    constexpr size_t c_unknown = 4;
+    auto countCodepoints = [](const auto& latencies) {
+        std::array<long long, 5> counts{};
+        for (const auto& stat : latencies)
+        {
+            if (stat.m_receiveTimestamp >= 0)
+            {
+                counts[stat.m_echoEcnCodepoint >= 0 && stat.m_echoEcnCodepoint <= 3 ? stat.m_echoEcnCodepoint : c_unknown] += 1;
+            }
+        }
+        return counts;
+    };
+    auto percent = [](auto a, auto b) { return b > 0 ? a * 100. / b : 0.; };
+
+    std::cout << std::setprecision(2) << std::fixed;
+
+    std::cout << '\n';
+    std::cout << "--- ECN ---\n";
+    for (const auto* path : {&data.m_primary, &data.m_secondary})
+    {
+        const auto* pathName = path == &data.m_primary ? "primary interface" : "secondary interface";
+        const auto counts = countCodepoints(path->m_latencies);
+        const auto known = counts[0] + counts[1] + counts[2] + counts[3];
+
+        std::cout << '\n';
+        std::cout << "ECN field of the datagrams received by the server on " << pathName << " (Not-ECT / ECT(1) / ECT(0) / CE): "
+                  << counts[0] << " / " << counts[1] << " / " << counts[2] << " / " << counts[3] << " (" << counts[c_unknown]
+                  << " unknown)\n";
+        std::cout << "Congestion Experienced marks on " << pathName << ": " << percent(counts[3], known) << "%\n";
+        if (counts[0] > 0)
+        {
+            std::cout << counts[0] << " datagrams lost their ECT mark on the way to the server (" << percent(counts[0], known)
+                      << "%): the network does not support ECN on " << pathName << '\n';
+        }
+    }
+}
+
+LatencyData LoadLatencyData(std::ifstream& file)
+{
+    constexpr size_t c_columnCount = 7;
+
+    LatencyData data;
+    std::string line;
+
+    // Skip the column header
+    std::getline(file, line);
+
+    while (std::getline(file, line))
+    {
+        if (line.empty())
+        {
+            continue;
+        }
+
+        std::array<long long, c_columnCount> values{};
+        const char* current = line.data();
+        const char* const end = line.data() + line.size();
+        for (size_t column = 0; column < c_columnCount; ++column)
+        {
+            while (current < end && (*current == ' ' || *current == ','))
+            {
+                ++current;
+            }
+
+            const auto [next, error] = std::from_chars(current, end, values[column]);
+            if (error != std::errc{})
+            {
+                throw std::runtime_error("Invalid latency data line: " + line);
+            }
+            current = next;
+        }
+
+        // The sequence number is the line index: DumpLatencyData writes every sequence number in order
+        data.m_primary.m_latencies.push_back({values[1], values[2], values[3]});
+        data.m_secondary.m_latencies.push_back({values[4], values[5], values[6]});
+    }
+
+    return data;
+}
+
 } // namespace multipath
\ No newline at end of file
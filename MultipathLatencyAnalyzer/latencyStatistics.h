@@ -4,13 +4,25 @@
 #pragma once
 
 #include <fstream>
+#include <new>
 #include <vector>
 
 namespace multipath {
 
+constexpr double ConvertNanosToMillis(long long nanos) noexcept
+{
+    return nanos / 1'000'000.;
+}
+
+constexpr double ConvertNanosToSeconds(long long nanos)
+{
+    return nanos / 1'000'000'000.;
+}
+
+// Timestamps of a single datagram on both interfaces, joined by sequence number for analysis
 struct LatencyMeasure
 {
-    // All timestamps are in microseconds
+    // All timestamps are in nanoseconds
     long long m_primarySendTimestamp = -1;
     long long m_secondarySendTimestamp = -1;
 
@@ -19,18 +31,125 @@ struct LatencyMeasure
 
     long long m_primaryReceiveTimestamp = -1;
     long long m_secondaryReceiveTimestamp = -1;
+
+    // The ECN field of the datagram received by the server, -1 if unknown
+    int m_primaryEcnCodepoint = -1;
+    int m_secondaryEcnCodepoint = -1;
+};
+
+// Timestamps of a single datagram on one interface
+struct PathLatencyMeasure
+{
+    // All timestamps are in nanoseconds
+    long long m_sendTimestamp = -1;
+    long long m_echoTimestamp = -1;
+    long long m_receiveTimestamp = -1;
+
+    // The ECN field of the datagram received by the server, -1 if unknown
+    int m_echoEcnCodepoint = -1;
+};
+
+// Cache line size on all the supported architectures (x86, x64, ARM64)
+constexpr size_t c_cacheLineSize = 64;
+
+// Allocates storage starting and ending on a cache line boundary,
+// so two containers using it never share a cache line
+template <typename T>
+struct CacheAlignedAllocator
+{
+    using value_type = T;
+
+    CacheAlignedAllocator() noexcept = default;
+    template <typename U>
+    CacheAlignedAllocator(const CacheAlignedAllocator<U>&) noexcept
+    {
+    }
+
+    [[nodiscard]] T* allocate(size_t count)
+    {
+        return static_cast<T*>(::operator new(RoundUpToCacheLine(count * sizeof(T)), std::align_val_t{c_cacheLineSize}));
+    }
+
+    void deallocate(T* pointer, size_t count) noexcept
+    {
+        ::operator delete(pointer, RoundUpToCacheLine(count * sizeof(T)), std::align_val_t{c_cacheLineSize});
+    }
+
+    template <typename U>
+    bool operator==(const CacheAlignedAllocator<U>&) const noexcept
+    {
+        return true;
+    }
+
+private:
+    static constexpr size_t RoundUpToCacheLine(size_t size) noexcept
+    {
+        return (size + c_cacheLineSize - 1) / c_cacheLineSize * c_cacheLineSize;
+    }
+};
+
+// The data collected on one interface.
+// Each interface has its own instance, so the primary and secondary completion threads never write to the same cache
+// line. The measure of a datagram is only written by the completions of the socket that sent it (serialized by the
+// socket lock). The counters are copied at the end of the run from the atomic counters of the client, as the
+// sockets of the traffic classes, the flows or the targets of an interface complete concurrently.
+struct alignas(c_cacheLineSize) PathLatencyData
+{
+    std::vector<PathLatencyMeasure, CacheAlignedAllocator<PathLatencyMeasure>> m_latencies;
+
+    long long m_corruptDatagrams = 0;
+
+    // Datagrams received after the end-of-run drain window: they are not part of the measures and count as lost
+    long long m_lateDatagrams = 0;
+
+    // Datagrams the client dropped before sending them, all the send buffers being in flight: they are neither sent
+    // nor lost
+    long long m_sendRingDrops = 0;
+
+    // Socket settings at the end of the run, possibly grown by the autotuner
+    int m_socketBufferSize = 0; // Bytes
+    size_t m_receiveDepth = 0;
+
+    // Absolute error of the online latency predictions, in nanoseconds
+    long long m_predictionErrorMedian = 0;
+    long long m_predictionError99 = 0;
+    long long m_predictionError999 = 0;
 };
 
 struct LatencyData
 {
-    std::vector<LatencyMeasure> m_latencies;
+    PathLatencyData m_primary;
+    PathLatencyData m_secondary;
 
     size_t m_datagramSize = 0;
-    long long m_primaryCorruptDatagrams = 0;
-    long long m_secondaryCorruptDatagrams = 0;
+
+    // Datagrams discarded by the client host UDP receive queues during the run (all sockets of the address families of the targets)
+    long long m_hostReceiveDrops = 0;
+
+    // Send timer ticks, ticks that ran after the next one was due, and ticks dropped by the overrun policy
+    long long m_timerTicks = 0;
+    long long m_lateTimerTicks = 0;
+    long long m_skippedTimerTicks = 0;
+
+    // Delay between the due time of the send timer ticks and their execution, in nanoseconds
+    long long m_timerLatenessMedian = 0;
+    long long m_timerLateness99 = 0;
+    long long m_timerLateness999 = 0;
+    long long m_timerLatenessMaximum = 0;
 };
 
-void PrintLatencyStatistics(LatencyData& data);
+// Join the per-interface data by sequence number
+std::vector<LatencyMeasure> JoinLatencyMeasures(const LatencyData& data);
+
+// deadlines are in milliseconds: the ratio and the goodput of the datagrams received within each deadline are displayed
+void PrintLatencyStatistics(LatencyData& data, const std::vector<unsigned long>& deadlines);
 void DumpLatencyData(const LatencyData& data, std::ofstream& file);
 
+// The ECN field of the datagrams received by the server on each interface: the ratio of Congestion Experienced marks
+// shows the congestion before it causes losses
+void PrintEcnStatistics(const LatencyData& data);
+
+// Read back the timestamps written by DumpLatencyData. The datagram size and the counters are not part of the file.
+LatencyData LoadLatencyData(std::ifstream& file);
+
 } // namespace multipath
\ No newline at end of file
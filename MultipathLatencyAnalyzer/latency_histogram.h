@@ -0,0 +1,110 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cmath>
+
+namespace multipath {
+
+// Streaming histogram of latencies (or any non-negative value), cheap enough to update for every datagram.
+// Values are grouped by power of two, each power of two being split in 16 linear sub-buckets: the relative error of
+// a percentile is below 1/16 (~6%), for any value.
+// The counters are relaxed atomics: several writers can record concurrently (the sockets of the flows of a path), and
+// readers on other threads can query it at any time.
+class LatencyHistogram
+{
+public:
+    LatencyHistogram() noexcept = default;
+    ~LatencyHistogram() noexcept = default;
+
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+    LatencyHistogram(LatencyHistogram&&) = delete;
+    LatencyHistogram& operator=(LatencyHistogram&&) = delete;
+
+    void Record(long long value) noexcept
+    {
+        const auto index = GetBucketIndex(value > 0 ? static_cast<unsigned long long>(value) : 0ULL);
+        m_buckets[index].fetch_add(1, std::memory_order_relaxed);
+        m_count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] long long GetCount() const noexcept
+    {
+        return static_cast<long long>(m_count.load(std::memory_order_relaxed));
+    }
+
+    // Returns the upper bound of the bucket holding the given percentile (0 to 100), or 0 if no value was recorded
+    [[nodiscard]] long long GetPercentile(double percentile) const noexcept
+    {
+        const auto count = m_count.load(std::memory_order_relaxed);
+        if (count == 0)
+        {
+            return 0;
+        }
+
+        const auto target = (std::max)(1ULL, static_cast<unsigned long long>(std::ceil(percentile / 100. * count)));
+        unsigned long long cumulativeCount = 0;
+        for (size_t i = 0; i < m_buckets.size(); ++i)
+        {
+            cumulativeCount += m_buckets[i].load(std::memory_order_relaxed);
+            if (cumulativeCount >= target)
+            {
+                return GetBucketUpperBound(i);
+            }
+        }
+
+        // Concurrent updates may make the buckets sum lower than the count
+        return GetBucketUpperBound(m_buckets.size() - 1);
+    }
+
+    void Reset() noexcept
+    {
+        for (auto& bucket : m_buckets)
+        {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+        m_count.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    static constexpr int c_subBucketBits = 4;
+    static constexpr unsigned long long c_subBucketCount = 1ULL << c_subBucketBits;
+    static constexpr size_t c_bucketCount = 64 * c_subBucketCount;
+
+    static constexpr size_t GetBucketIndex(unsigned long long value) noexcept
+    {
+        // Small values are stored exactly
+        if (value < c_subBucketCount)
+        {
+            return static_cast<size_t>(value);
+        }
+
+        const int exponent = 63 - std::countl_zero(value);
+        const auto subBucket = (value >> (exponent - c_subBucketBits)) & (c_subBucketCount - 1);
+        return static_cast<size_t>((exponent - c_subBucketBits + 1) * c_subBucketCount + subBucket);
+    }
+
+    static constexpr long long GetBucketUpperBound(size_t index) noexcept
+    {
+        if (index < c_subBucketCount)
+        {
+            return static_cast<long long>(index);
+        }
+
+        const auto exponent = static_cast<int>(index / c_subBucketCount) + c_subBucketBits - 1;
+        const auto subBucket = index % c_subBucketCount;
+        const auto lowerBound = (c_subBucketCount + subBucket) << (exponent - c_subBucketBits);
+        return static_cast<long long>(lowerBound + (1ULL << (exponent - c_subBucketBits)) - 1);
+    }
+
+    std::array<std::atomic<unsigned long long>, c_bucketCount> m_buckets{};
+    std::atomic<unsigned long long> m_count{0};
+};
+
+} // namespace multipath
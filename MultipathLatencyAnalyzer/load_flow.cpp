@@ -0,0 +1,195 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#include "load_flow.h"
+#include "logs.h"
+#include "measuredSocket.h"
+#include "monotonic_clock.h"
+#include "socket_utils.h"
+
+#include <wil/result.h>
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+namespace multipath {
+namespace {
+
+    // A timer stall must not turn into an unbounded burst
+    constexpr long long c_maxDatagramsPerTick = 1024;
+
+    struct LatencyPercentiles
+    {
+        long long m_count = 0;
+        long long m_median = 0; // Nanosec
+        long long m_p99 = 0;    // Nanosec
+    };
+
+    LatencyPercentiles ComputePercentiles(std::vector<long long>& latencies) noexcept
+    {
+        LatencyPercentiles percentiles;
+        percentiles.m_count = static_cast<long long>(latencies.size());
+        if (!latencies.empty())
+        {
+            std::ranges::sort(latencies);
+            percentiles.m_median = latencies[latencies.size() / 2];
+            percentiles.m_p99 = latencies[(std::min)(latencies.size() - 1, latencies.size() * 99 / 100)];
+        }
+        return percentiles;
+    }
+
+} // namespace
+
+LoadFlow::LoadFlow(const ctl::ctSockaddr& targetAddress, int interfaceIndex, unsigned long bitRate) :
+    m_socket{CreateDatagramSocket(targetAddress.family())}, m_bitRate{bitRate}
+{
+    SetSocketSendBufferSize(m_socket.get(), MeasuredSocket::c_defaultSocketBufferSize);
+    SetSocketOutgoingInterface(m_socket.get(), targetAddress.family(), interfaceIndex);
+
+    const auto error = WSAConnect(m_socket.get(), targetAddress.sockaddr(), targetAddress.length(), nullptr, nullptr, nullptr, nullptr);
+    THROW_LAST_ERROR_IF_MSG(SOCKET_ERROR == error, "WSAConnect failed");
+
+    for (size_t i = 0; i < m_sendBuffer.m_buffer.size(); ++i)
+    {
+        m_sendBuffer.m_buffer[i] = static_cast<char>(i);
+    }
+    m_sendBuffer.GetHeader() = {c_loadSequenceNumber, 0, 0, c_unknownEcnCodepoint};
+
+    m_threadpoolTimer = std::make_unique<ThreadpoolTimer>([this]() noexcept { TimerCallback(); });
+}
+
+LoadFlow::~LoadFlow() noexcept
+{
+    // Wait for the callbacks before closing the socket
+    m_threadpoolTimer.reset();
+}
+
+void LoadFlow::Start() noexcept
+{
+    Log<LogLevel::Info>("Starting the load flow at %lu bits per second\n", m_bitRate);
+    m_startTimestamp = SnapMonotonicNanoSec();
+    m_threadpoolTimer->Schedule(c_tickInterval, TimerOverrunPolicy::Skip);
+}
+
+void LoadFlow::Stop() noexcept
+{
+    if (m_startTimestamp < 0 || m_stopTimestamp >= 0)
+    {
+        return;
+    }
+
+    m_threadpoolTimer->StopAndWait();
+    m_stopTimestamp = SnapMonotonicNanoSec();
+    Log<LogLevel::Info>(
+        "Load flow stopped, %lld datagrams sent, %lld sends failed, %lld datagrams skipped after a stall\n",
+        m_sentDatagrams,
+        m_failedSends,
+        m_skippedDatagrams);
+}
+
+void LoadFlow::TimerCallback() noexcept
+{
+    // The datagrams due since the start, so that the timer resolution does not lower the bitrate
+    const auto elapsed = SnapMonotonicNanoSec() - m_startTimestamp;
+    const auto dueDatagrams = static_cast<long long>(
+        static_cast<double>(elapsed) * m_bitRate / 8 / c_nanoSecInSecond / MeasuredSocket::c_bufferSize);
+    auto count = dueDatagrams - m_sentDatagrams - m_failedSends - m_skippedDatagrams;
+    if (count > c_maxDatagramsPerTick)
+    {
+        // Give up the rest of the backlog, or each following tick would burst until it is caught up
+        m_skippedDatagrams += count - c_maxDatagramsPerTick;
+        count = c_maxDatagramsPerTick;
+    }
+
+    for (long long i = 0; i < count; ++i)
+    {
+        // A blocking send: when the interface queue is full, the load flow slows down to the link rate
+        if (SOCKET_ERROR == send(m_socket.get(), m_sendBuffer.m_buffer.data(), static_cast<int>(m_sendBuffer.m_buffer.size()), 0))
+        {
+            Log<LogLevel::Debug>("Load flow send failed: %d\n", WSAGetLastError());
+            m_failedSends += 1;
+            continue;
+        }
+        m_sentDatagrams += 1;
+    }
+}
+
+void LoadFlow::PrintStatistics(const LatencyData& data, size_t loadedPath) const
+{
+    const auto loadStart = m_startTimestamp.load();
+    const auto loadStop = m_stopTimestamp >= 0 ? m_stopTimestamp.load() : SnapMonotonicNanoSec();
+
+    // Idle: sent before the load started. Loaded: sent while the load was running.
+    std::vector<long long> idleLatencies[3];
+    std::vector<long long> loadedLatencies[3];
+    const auto& primary = data.m_primary.m_latencies;
+    const auto& secondary = data.m_secondary.m_latencies;
+    auto first = [](long long a, long long b) { return a < 0 ? b : (b < 0 ? a : (std::min)(a, b)); };
+    auto classify = [&](size_t path, long long send, long long receive) {
+        if (send < 0 || receive < 0)
+        {
+            return;
+        }
+        if (send < loadStart)
+        {
+            idleLatencies[path].push_back(receive - send);
+        }
+        else if (send < loadStop)
+        {
+            loadedLatencies[path].push_back(receive - send);
+        }
+    };
+
+    for (size_t i = 0; i < (std::max)(primary.size(), secondary.size()); ++i)
+    {
+        const PathLatencyMeasure empty{};
+        const auto& p = i < primary.size() ? primary[i] : empty;
+        const auto& s = i < secondary.size() ? secondary[i] : empty;
+        classify(0, p.m_sendTimestamp, p.m_receiveTimestamp);
+        classify(1, s.m_sendTimestamp, s.m_receiveTimestamp);
+
+        // The combined interfaces: from the first send to the first echo received, on any interface
+        classify(2, first(p.m_sendTimestamp, s.m_sendTimestamp), first(p.m_receiveTimestamp, s.m_receiveTimestamp));
+    }
+
+    const char* pathNames[] = {"primary interface", "secondary interface", "combined interfaces"};
+    const auto loadDuration = ConvertNanosToSeconds(loadStop - loadStart);
+    const auto loadBitRate = loadDuration > 0 ? m_sentDatagrams * MeasuredSocket::c_bufferSize * 8 / loadDuration : 0.;
+
+    std::cout << std::setprecision(2) << std::fixed;
+
+    std::cout << '\n';
+    std::cout << "--- LATENCY UNDER LOAD ---\n";
+    std::cout << '\n';
+    std::cout << "Load flow on " << pathNames[loadedPath] << ": " << m_sentDatagrams << " datagrams sent in " << loadDuration
+              << " s, " << loadBitRate / 1024 << " kbps (target: " << m_bitRate / 1024 << " kbps)\n";
+
+    LatencyPercentiles inflations[3];
+    for (size_t path = 0; path < 3; ++path)
+    {
+        const auto idle = ComputePercentiles(idleLatencies[path]);
+        const auto loaded = ComputePercentiles(loadedLatencies[path]);
+        inflations[path] = {loaded.m_count, loaded.m_median - idle.m_median, loaded.m_p99 - idle.m_p99};
+
+        std::cout << '\n';
+        std::cout << "Idle latency on " << pathNames[path] << " (median / 99th percentile): " << ConvertNanosToMillis(idle.m_median)
+                  << " ms / " << ConvertNanosToMillis(idle.m_p99) << " ms (" << idle.m_count << " datagrams)\n";
+        std::cout << "Loaded latency on " << pathNames[path] << " (median / 99th percentile): " << ConvertNanosToMillis(loaded.m_median)
+                  << " ms / " << ConvertNanosToMillis(loaded.m_p99) << " ms (" << loaded.m_count << " datagrams)\n";
+        std::cout << "Latency inflation on " << pathNames[path] << " (median / 99th percentile): "
+                  << ConvertNanosToMillis(inflations[path].m_median) << " ms / " << ConvertNanosToMillis(inflations[path].m_p99) << " ms\n";
+    }
+
+    // How much of the queueing on the loaded interface the combined interfaces avoided
+    if (inflations[loadedPath].m_p99 > 0 && inflations[2].m_count > 0)
+    {
+        const auto shielded = inflations[loadedPath].m_p99 - (std::max)(inflations[2].m_p99, 0LL);
+        std::cout << '\n';
+        std::cout << "The combined interfaces avoided " << shielded * 100. / inflations[loadedPath].m_p99
+                  << "% of the 99th percentile latency inflation on the " << pathNames[loadedPath] << '\n';
+    }
+}
+
+} // namespace multipath
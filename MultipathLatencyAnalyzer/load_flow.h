@@ -0,0 +1,65 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <Windows.h>
+#include <WinSock2.h>
+
+#include <wil/resource.h>
+
+#include <atomic>
+#include <memory>
+
+#include "datagram.h"
+#include "latencyStatistics.h"
+#include "sockaddr.h"
+#include "threadpool_timer.h"
+
+namespace multipath {
+
+// A bulk flow of datagrams sent at a constant bitrate on one interface, on its own socket, to fill the queues along
+// the path. The server does not echo the load datagrams (see c_loadSequenceNumber).
+class LoadFlow
+{
+public:
+    // Pace the sends every millisecond: each tick sends the datagrams due since the flow started
+    static constexpr unsigned long c_tickInterval = 10'000; // 100 nanosec
+
+    LoadFlow(const ctl::ctSockaddr& targetAddress, int interfaceIndex, unsigned long bitRate);
+    ~LoadFlow() noexcept;
+
+    LoadFlow(const LoadFlow&) = delete;
+    LoadFlow& operator=(const LoadFlow&) = delete;
+    LoadFlow(LoadFlow&&) = delete;
+    LoadFlow& operator=(LoadFlow&&) = delete;
+
+    void Start() noexcept;
+    void Stop() noexcept;
+
+    [[nodiscard]] bool IsStarted() const noexcept
+    {
+        return m_startTimestamp >= 0;
+    }
+
+    // Compare the latency of the datagrams sent before the load started (idle) with the latency of those sent while
+    // it was running (loaded), on each interface and on the combined interfaces. loadedPath is 0 when the load flow
+    // runs on the primary interface, 1 on the secondary interface. Must be called after Start.
+    void PrintStatistics(const LatencyData& data, size_t loadedPath) const;
+
+private:
+    void TimerCallback() noexcept;
+
+    wil::unique_socket m_socket;
+    std::unique_ptr<ThreadpoolTimer> m_threadpoolTimer;
+    DatagramSendBuffer m_sendBuffer;
+    unsigned long m_bitRate = 0;
+
+    std::atomic<long long> m_startTimestamp{-1}; // Nanosec
+    std::atomic<long long> m_stopTimestamp{-1};  // Nanosec
+    long long m_sentDatagrams = 0;
+    long long m_failedSends = 0;
+    long long m_skippedDatagrams = 0; // Given up after a stall, see c_maxDatagramsPerTick
+};
+
+} // namespace multipath
@@ -5,15 +5,25 @@
 #include "adapters.h"
 #include "config.h"
 #include "logs.h"
+#include "datagram.h"
+#include "monotonic_clock.h"
+#include "policy_replay.h"
 #include "sockaddr.h"
 #include "stream_client.h"
 #include "stream_server.h"
 
+#include <algorithm>
+#include <array>
+#include <climits>
 #include <stdexcept>
 #include <iostream>
 #include <fstream>
 #include <filesystem>
 #include <locale>
+#include <numeric>
+#include <ranges>
+#include <sstream>
+#include <string>
 
 #include <Windows.h>
 #include <winrt/Windows.Foundation.h>
@@ -75,12 +85,33 @@ void PrintUsage()
         L"\nOnce started, Ctrl-C or Ctrl-Break will cleanly shutdown the application."
         L"\n\n"
         L"Server-side usage:\n"
-        L"\tMultipathLatencyTool -listen:<addr or *> [-port:####] [-prepostrecvs:####]\n"
+        L"\tMultipathLatencyTool -listen:<addr or *> [-echo:<full,header>] [-port:####] [-prepostrecvs:####] [-clock:<qpc,tsc>] "
+        L"[-offload:<0,1>] [-autotune:<0,1>]\n"
+        L"\n"
+        L"Replay usage:\n"
+        L"\tMultipathLatencyTool -replay:<path>\n"
         L"\n"
         L"Client-side usage:\n"
-        L"\tMultipathLatencyTool -target:<addr or name> [-port:####] [-bitrate:<see below>] [-grouping:<see below>] "
-        L"[-duration:####] [-secondary:#] [-output:<path>]"
-        L"[-prepostrecvs:####]\n"
+        L"\tMultipathLatencyTool -target:<addr or name>,... [-addresses:<first,best,all>] [-port:####] [-bitrate:<see below>] "
+        L"[-grouping:<see below>] [-duration:####] [-secondary:#] [-output:<path>] [-overrun:<burst,skip,spread>] "
+        L"[-predictor:<ewma,kalman>] [-deadlines:####,####...] [-frames:<0,1>] [-load:<primary,secondary>] "
+        L"[-loadrate:##] [-classes:<vo,vi,be,bk>,...] [-flows:####] [-ecn:<ect0,ect1>] [-prepostrecvs:####] "
+        L"[-clock:<qpc,tsc>] [-offload:<0,1>] [-autotune:<0,1>]\n"
+        L"\n"
+        L"Capacity search usage:\n"
+        L"\tMultipathLatencyTool -target:<addr or name> -search:<binary,aimd> [-addresses:<first,best>] [-searchrange:##,##] "
+        L"[-searchloss:##] [-searchlatency:####] [-searchtrial:####] [-grouping:<see below>] [-secondary:#] [-overrun:<burst,skip,spread>] "
+        L"[-port:####] [-prepostrecvs:####] [-clock:<qpc,tsc>] [-offload:<0,1>] [-autotune:<0,1>]\n"
+        L"\n"
+        L"Bandwidth probe usage:\n"
+        L"\tMultipathLatencyTool -target:<addr or name> -bandwidth:1 [-addresses:<first,best>] [-trainlength:####] [-secondary:#] "
+        L"[-port:####] [-prepostrecvs:####] [-clock:<qpc,tsc>] [-offload:<0,1>] [-autotune:<0,1>]\n"
+        L"\n"
+        L"Scenario usage:\n"
+        L"\tMultipathLatencyTool -target:<addr or name> -scenario:<path> [-addresses:<first,best>] [-bitrate:<see below>] "
+        L"[-grouping:<see below>] [-duration:####] [-overrun:<burst,skip,spread>] [-secondary:#] [-output:<path>] "
+        L"[-predictor:<ewma,kalman>] [-deadlines:####,####...] [-ecn:<ect0,ect1>] [-port:####] [-prepostrecvs:####] "
+        L"[-clock:<qpc,tsc>] [-offload:<0,1>] [-autotune:<0,1>]\n"
         L"\n\n"
         L"---------------------------------------------------------\n"
         L"                      Common Options                     \n"
@@ -91,6 +122,20 @@ void PrintUsage()
         L"-prepostrecvs:####\n"
         L"\t- the number of receive requests to be kept in-flight\n"
         L"\t- (default value: 2)\n"
+        L"-clock:<qpc,tsc>\n"
+        L"\t- the clock used to timestamp datagrams, with a nanosecond resolution:\n"
+        L"\t\t- qpc uses QueryPerformanceCounter (default)\n"
+        L"\t\t- tsc reads the processor's invariant time-stamp counter directly, calibrated against QPC at startup.\n"
+        L"\t\t  QPC is used if the processor does not have an invariant TSC.\n"
+        L"-offload:<0,1>\n"
+        L"\t- whether or not use UDP receive offload (the sends are always batched with segmentation offload if available):\n"
+        L"\t\t- set to 1 to let the network stack coalesce receives, for high bitrates\n"
+        L"\t\t- set to 0 to receive each datagram individually (default)\n"
+        L"-autotune:<0,1>\n"
+        L"\t- whether or not grow the socket buffers and the number of receive requests during the run:\n"
+        L"\t\t- set to 1 to size the socket buffers from the bitrate and the observed round-trip times, and post more\n"
+        L"\t\t  receive requests when receives complete faster than they are posted or datagrams are dropped\n"
+        L"\t\t- set to 0 to keep the default 1MB socket buffers and -prepostrecvs receive requests (default)\n"
         L"-help\n"
         L"\t- prints this usage information\n"
         L"\n\n"
@@ -98,13 +143,28 @@ void PrintUsage()
         L"                      Server Options                     \n"
         L"---------------------------------------------------------\n"
         L"-listen:<addr or *>\n"
-        L"\t- the IP address on which the server will listen for incoming datagrams, or '*' for all addresses\n"
+        L"\t- the IP address on which the server will listen for incoming datagrams, or '*' for all addresses of both\n"
+        L"\t  IPv4 and IPv6 (IPv4 only when IPv6 is disabled on the host)\n"
+        L"-echo:<full,header>\n"
+        L"\t- what the server sends back of each datagram:\n"
+        L"\t\t- full echoes the whole datagram, the path back to the client carries as much as the path to the server\n"
+        L"\t\t  (default)\n"
+        L"\t\t- header only echoes the header of the datagram with the timestamps, to measure the path to the server at\n"
+        L"\t\t  high bitrates without loading the path back to the client\n"
         L"\n\n"
         L"---------------------------------------------------------\n"
         L"                      Client Options                     \n"
         L"---------------------------------------------------------\n"
-        L"-target:<addr or name>\n"
-        L"\t- the IP address, FQDN, or hostname to connect to\n"
+        L"-target:<addr or name>,...\n"
+        L"\t- the IP address, FQDN, or hostname to connect to. In client mode, a comma separated list of targets measures\n"
+        L"\t  all of them at the same time: the datagrams are sent to the targets in turn, sharing the bitrate, and the\n"
+        L"\t  losses and the latency of each target are displayed. Cannot be combined with -classes or -flows\n"
+        L"-addresses:<first,best,all>\n"
+        L"\t- how to pick among the IPv4 and IPv6 addresses a target name resolves to:\n"
+        L"\t\t- first uses the first address returned by the resolver (default)\n"
+        L"\t\t- best checks the connectivity to all the addresses at the same time, displays their handshake\n"
+        L"\t\t  round-trip times, and uses the fastest one. An unreachable address delays the start by 20 seconds\n"
+        L"\t\t- all probes the addresses the same way, then measures each of them as a separate target (client mode)\n"
         L"-bitrate:<sd,hd,4k,##>\n"
         L"\t- the rate at which to send data; based on common video streaming rates:\n"
         L"\t\t- sd sends data at 3 megabits per second\n"
@@ -120,7 +180,97 @@ void PrintUsage()
         L"\t\t- set to 1 to make a best effort of using a secondary interface (default)\n"
         L"\t\t- set to 0 to not use a secondary interface. This can be used for comparison.\n"
         L"-output:<path>\n"
-        L"\t- the path of a file where measured data will be stored\n");
+        L"\t- the path of a file where measured data will be stored\n"
+        L"-replay:<path>\n"
+        L"\t- replay a file written with -output through multipath scheduling policies, and compare their latency,\n"
+        L"\t  loss and amount of data sent. The datagrams must have been sent on both interfaces.\n"
+        L"-overrun:<burst,skip,spread>\n"
+        L"\t- what the sender does when send ticks are missed, because the process was not scheduled in time:\n"
+        L"\t\t- burst sends the missed ticks back to back (default)\n"
+        L"\t\t- skip drops the missed ticks, keeping the spacing between sends but extending the run\n"
+        L"\t\t- spread sends the missed ticks at twice the nominal rate until the schedule is caught up\n"
+        L"-predictor:<ewma,kalman>\n"
+        L"\t- the model predicting the latency of the next datagram on each interface:\n"
+        L"\t\t- ewma uses a smoothed average and mean deviation, as TCP's retransmission timer (default)\n"
+        L"\t\t- kalman uses a one-dimensional Kalman filter\n"
+        L"-deadlines:####,####...\n"
+        L"\t- comma separated latencies, in milliseconds, within which a datagram is useful to the application.\n"
+        L"\t  The ratio and goodput of the datagrams received within each deadline are displayed (default: 30,50,100)\n"
+        L"-frames:<0,1>\n"
+        L"\t- whether or not treat the datagrams sent together (see -grouping) as an application frame:\n"
+        L"\t\t- set to 1 to display the frames completed on each interface and on both combined, the frames lost, and\n"
+        L"\t\t  the frame completion latency, from the first datagram sent to the last datagram received\n"
+        L"\t\t- set to 0 to only display per-datagram statistics (default)\n"
+        L"-classes:<vo,vi,be,bk>,...\n"
+        L"\t- comma separated WMM access categories (voice, video, best effort, background). Each class has its own\n"
+        L"\t  socket on each interface, marked with the DSCP value and the 802.1p priority of the class, and the\n"
+        L"\t  datagrams are sent on the classes in turn. The losses and the latency of each class are displayed.\n"
+        L"\t  Only the datagrams sent by the client are marked, the echoes use the default marking of the server\n"
+        L"-flows:####\n"
+        L"\t- the number of flows on each interface, up to 4096. Each flow has its own socket, hence its own source\n"
+        L"\t  port, and the datagrams are sent on the flows in turn. The spread of the losses and of the latency over\n"
+        L"\t  the flows, their fairness and the worst flows are displayed. Cannot be combined with -classes (default: 1)\n"
+        L"-ecn:<ect0,ect1>\n"
+        L"\t- mark the datagrams as ECN-capable with the given codepoint. The server reports the ECN field of each\n"
+        L"\t  datagram it receives in the echo, and the ratio of Congestion Experienced marks on each interface is\n"
+        L"\t  displayed: the congestion shows before it causes losses (default: not marked)\n"
+        L"-load:<primary,secondary>\n"
+        L"\t- saturate an interface with a bulk flow, on its own socket, during the second half of the run. The\n"
+        L"\t  server does not echo the load datagrams. The latency of the datagrams sent before and during the load\n"
+        L"\t  is compared on each interface and on the combined interfaces\n"
+        L"-loadrate:##\n"
+        L"\t- the bitrate of the load flow in megabits per second, above the capacity of the interface to\n"
+        L"\t  saturate it (default: 100)\n"
+        L"\n\n"
+        L"---------------------------------------------------------\n"
+        L"                  Capacity Search Options                \n"
+        L"---------------------------------------------------------\n"
+        L"-search:<binary,aimd>\n"
+        L"\t- search the highest bitrate each interface sustains within a loss and latency budget, in short trials\n"
+        L"\t  on the same sockets. Each interface is searched in turn, the other one staying idle:\n"
+        L"\t\t- binary tries the minimum and maximum bitrates, then bisects between the highest passing and the\n"
+        L"\t\t  lowest failing bitrates, until they are within 5% of each other\n"
+        L"\t\t- aimd starts at the minimum bitrate, adds 1/16th of the range after each passing trial and halves\n"
+        L"\t\t  the bitrate after each failing trial\n"
+        L"\t- a search runs at most 16 trials per interface\n"
+        L"\t- cannot be combined with -bandwidth, -scenario, -classes, -flows, -frames, -load or -ecn\n"
+        L"-searchrange:##,##\n"
+        L"\t- the minimum and maximum bitrates of the search, in megabits per second (default: 1,100)\n"
+        L"-searchloss:##\n"
+        L"\t- the maximum percentage of datagrams lost for a trial to pass (default: 1)\n"
+        L"-searchlatency:####\n"
+        L"\t- the maximum 99th percentile latency, in milliseconds, for a trial to pass (default: 50)\n"
+        L"-searchtrial:####\n"
+        L"\t- the duration of each trial, in seconds (default: 2)\n"
+        L"\n\n"
+        L"---------------------------------------------------------\n"
+        L"                  Bandwidth Probe Options                \n"
+        L"---------------------------------------------------------\n"
+        L"-bandwidth:<0,1>\n"
+        L"\t- whether or not estimate the bandwidth of each interface in a few hundred milliseconds, without\n"
+        L"\t  saturating it, from the spacing of short bursts at the server:\n"
+        L"\t\t- set to 1 to send 16 back to back packet pairs, giving the bottleneck capacity, then 8 packet trains\n"
+        L"\t\t  paced from 1/8th to the whole capacity, giving the available bandwidth: the highest bitrate at\n"
+        L"\t\t  which a train reaches the server at 90% of its send rate or more\n"
+        L"\t\t- set to 0 to stream at a fixed bitrate (default)\n"
+        L"\t- the server must not use receive offload (-offload:0), which would give coalesced datagrams the same\n"
+        L"\t  receive timestamp\n"
+        L"\t- cannot be combined with -search, -scenario, -classes, -flows, -frames, -load or -ecn\n"
+        L"-trainlength:####\n"
+        L"\t- the number of datagrams in each packet train (default: 32)\n"
+        L"\n\n"
+        L"---------------------------------------------------------\n"
+        L"                     Scenario Options                    \n"
+        L"---------------------------------------------------------\n"
+        L"-scenario:<path>\n"
+        L"\t- a file describing phases to run one after the other on the same sockets, without setting up the\n"
+        L"\t  interfaces again. Each phase has its own statistics.\n"
+        L"\t- each line is a phase, with the following options separated by spaces; the options not given take\n"
+        L"\t  their value from the command line. Empty lines and lines starting with # are ignored.\n"
+        L"\t\t-name:<name> the name of the phase in the results (default: its number)\n"
+        L"\t\t-bitrate:<sd,hd,4k,##> -grouping:#### -duration:#### -overrun:<burst,skip,spread> as above\n"
+        L"\t\t-send:<both,primary,secondary> the interfaces on which each datagram is sent (default: both)\n"
+        L"\t- -ecn applies to every phase. Cannot be combined with -search, -bandwidth, -classes, -flows, -frames or -load\n");
 }
 
 std::wstring_view ParseArgumentValue(const std::wstring_view str)
@@ -151,6 +301,159 @@ std::optional<std::wstring_view> ParseArgument(const std::wstring_view name, std
     return {};
 }
 
+unsigned long ParseBitrate(const std::wstring_view bitrate)
+{
+    if (L"sd" == bitrate)
+    {
+        return Configuration::c_bitrateSd;
+    }
+    if (L"hd" == bitrate)
+    {
+        return Configuration::c_bitrateHd;
+    }
+    if (L"4k" == bitrate)
+    {
+        return Configuration::c_bitrate4K;
+    }
+    if (L"test" == bitrate)
+    {
+        return Configuration::c_testBitrate;
+    }
+
+    // Convert from mb/s to b/s
+    const auto bitrateInMbs = integer_cast<unsigned long>(bitrate);
+    if (bitrateInMbs < 1)
+    {
+        throw std::invalid_argument("-bitrate invalid argument");
+    }
+    return bitrateInMbs * 1024 * 1024;
+}
+
+TimerOverrunPolicy ParseOverrunPolicy(const std::wstring_view overrun)
+{
+    if (L"burst" == overrun)
+    {
+        return TimerOverrunPolicy::Burst;
+    }
+    if (L"skip" == overrun)
+    {
+        return TimerOverrunPolicy::Skip;
+    }
+    if (L"spread" == overrun)
+    {
+        return TimerOverrunPolicy::Spread;
+    }
+    throw std::invalid_argument("-overrun invalid argument");
+}
+
+// Each line of the file is a phase, described with the same syntax as the command line
+std::vector<ScenarioPhase> LoadScenario(const std::filesystem::path& path, const Configuration& config)
+{
+    std::wifstream file{path};
+    if (!file)
+    {
+        throw std::invalid_argument("-scenario invalid argument");
+    }
+
+    std::vector<ScenarioPhase> phases;
+    std::wstring line;
+    for (size_t lineNumber = 1; std::getline(file, line); ++lineNumber)
+    {
+        std::wistringstream lineStream{line};
+        std::vector<std::wstring> tokens;
+        for (std::wstring token; lineStream >> token;)
+        {
+            tokens.push_back(std::move(token));
+        }
+        if (tokens.empty() || tokens.front().starts_with(L'#'))
+        {
+            continue;
+        }
+
+        std::vector<const wchar_t*> args;
+        for (const auto& token : tokens)
+        {
+            args.push_back(token.c_str());
+        }
+
+        try
+        {
+            ScenarioPhase phase{
+                std::to_wstring(phases.size() + 1), config.m_bitrate, config.m_grouping, config.m_duration, config.m_timerOverrunPolicy};
+
+            if (auto name = ParseArgument(L"-name", args))
+            {
+                phase.m_name = *name;
+            }
+
+            if (auto bitrate = ParseArgument(L"-bitrate", args))
+            {
+                phase.m_bitRate = ParseBitrate(*bitrate);
+            }
+
+            if (auto grouping = ParseArgument(L"-grouping", args))
+            {
+                phase.m_grouping = integer_cast<unsigned long>(*grouping);
+                if (phase.m_grouping < 1)
+                {
+                    throw std::invalid_argument("-grouping invalid argument");
+                }
+            }
+
+            if (auto duration = ParseArgument(L"-duration", args))
+            {
+                phase.m_duration = integer_cast<unsigned long>(*duration);
+                if (phase.m_duration < 1)
+                {
+                    throw std::invalid_argument("-duration invalid argument");
+                }
+            }
+
+            if (auto overrun = ParseArgument(L"-overrun", args))
+            {
+                phase.m_overrunPolicy = ParseOverrunPolicy(*overrun);
+            }
+
+            if (auto send = ParseArgument(L"-send", args))
+            {
+                if (L"both" == send)
+                {
+                    phase.m_duplication = DuplicationPolicy::Both;
+                }
+                else if (L"primary" == send)
+                {
+                    phase.m_duplication = DuplicationPolicy::Primary;
+                }
+                else if (L"secondary" == send)
+                {
+                    phase.m_duplication = DuplicationPolicy::Secondary;
+                }
+                else
+                {
+                    throw std::invalid_argument("-send invalid argument");
+                }
+            }
+
+            if (!args.empty())
+            {
+                throw std::invalid_argument("Unknown arguments");
+            }
+
+            phases.push_back(std::move(phase));
+        }
+        catch (const std::invalid_argument& ex)
+        {
+            throw std::invalid_argument("-scenario line " + std::to_string(lineNumber) + ": " + ex.what());
+        }
+    }
+
+    if (phases.empty())
+    {
+        throw std::invalid_argument("-scenario file does not have any phase");
+    }
+    return phases;
+}
+
 Configuration ParseArguments(std::vector<const wchar_t*>& args)
 {
     Configuration config;
@@ -159,7 +462,8 @@ Configuration ParseArguments(std::vector<const wchar_t*>& args)
     {
         if (*listenAddress == L"*")
         {
-            config.m_listenAddress = ctl::ctSockaddr(AF_INET, ctl::ctSockaddr::AddressType::Any);
+            // A dual-mode socket serves both the IPv4 and the IPv6 clients (see StreamServer)
+            config.m_listenAddress = ctl::ctSockaddr(AF_INET6, ctl::ctSockaddr::AddressType::Any);
         }
         else
         {
@@ -181,19 +485,66 @@ Configuration ParseArguments(std::vector<const wchar_t*>& args)
             throw std::invalid_argument("cannot specify both -listen and -target");
         }
 
-        auto resolvedAddresses = ctl::ctSockaddr::ResolveName(targetAddress->data());
-        if (resolvedAddresses.empty())
+        for (const auto target : std::views::split(*targetAddress, L','))
+        {
+            const std::wstring targetName{target.begin(), target.end()};
+            auto resolvedAddresses = ctl::ctSockaddr::ResolveName(targetName.c_str());
+            if (resolvedAddresses.empty())
+            {
+                throw std::invalid_argument("-target parameter did not resolve to a valid address");
+            }
+
+            // pick the first resolved address from the list, until the addresses are probed (see SelectTargetAddresses)
+            if (config.m_targetAddress.family() == AF_UNSPEC)
+            {
+                config.m_targetAddress = resolvedAddresses.front();
+            }
+            else
+            {
+                config.m_additionalTargetAddresses.push_back(resolvedAddresses.front());
+            }
+            config.m_resolvedTargetAddresses.push_back(std::move(resolvedAddresses));
+        }
+    }
+
+    if (auto addresses = ParseArgument(L"-addresses", args))
+    {
+        if (L"first" == addresses)
+        {
+            config.m_addressSelection = AddressSelection::First;
+        }
+        else if (L"best" == addresses)
         {
-            throw std::invalid_argument("-target parameter did not resolve to a valid address");
+            config.m_addressSelection = AddressSelection::Best;
         }
+        else if (L"all" == addresses)
+        {
+            config.m_addressSelection = AddressSelection::All;
+        }
+        else
+        {
+            throw std::invalid_argument("-addresses invalid argument");
+        }
+    }
 
-        // just pick the first resolved address from the list
-        config.m_targetAddress = resolvedAddresses.front();
+    if (auto replayPath = ParseArgument(L"-replay", args))
+    {
+        if (config.m_listenAddress.family() != AF_UNSPEC || config.m_targetAddress.family() != AF_UNSPEC)
+        {
+            throw std::invalid_argument("cannot specify -replay with -listen or -target");
+        }
+
+        config.m_replayFile = *replayPath;
+        if (!std::filesystem::exists(config.m_replayFile))
+        {
+            throw std::invalid_argument("-replay invalid argument");
+        }
     }
 
-    if (config.m_listenAddress.family() == AF_UNSPEC && config.m_targetAddress.family() == AF_UNSPEC)
+    if (config.m_listenAddress.family() == AF_UNSPEC && config.m_targetAddress.family() == AF_UNSPEC &&
+        config.m_replayFile.empty())
     {
-        throw std::invalid_argument("-listen or -target must be specified");
+        throw std::invalid_argument("-listen, -target or -replay must be specified");
     }
 
     if (auto port = ParseArgument(L"-port", args))
@@ -203,59 +554,302 @@ Configuration ParseArguments(std::vector<const wchar_t*>& args)
 
     if (auto bitrate = ParseArgument(L"-bitrate", args))
     {
-        if (L"sd" == bitrate)
+        config.m_bitrate = ParseBitrate(*bitrate);
+    }
+
+    if (auto grouping = ParseArgument(L"-grouping", args))
+    {
+        config.m_grouping = integer_cast<unsigned long>(*grouping);
+        if (config.m_grouping < 1)
+        {
+            throw std::invalid_argument("-grouping invalid argument");
+        }
+    }
+
+    if (auto duration = ParseArgument(L"-duration", args))
+    {
+        config.m_duration = integer_cast<unsigned long>(*duration);
+        if (config.m_duration < 1)
+        {
+            throw std::invalid_argument("-duration invalid argument");
+        }
+    }
+
+    if (auto prepostRecvs = ParseArgument(L"-prepostrecvs", args))
+    {
+        config.m_prePostRecvs = integer_cast<unsigned long>(*prepostRecvs);
+        if (config.m_prePostRecvs < 1)
+        {
+            throw std::invalid_argument("-prepostrecvs invalid argument");
+        }
+    }
+
+    if (auto clock = ParseArgument(L"-clock", args))
+    {
+        if (L"tsc" == clock)
         {
-            config.m_bitrate = Configuration::c_bitrateSd;
+            config.m_useTscClock = true;
         }
-        else if (L"hd" == bitrate)
+        else if (L"qpc" != clock)
         {
-            config.m_bitrate = Configuration::c_bitrateHd;
+            throw std::invalid_argument("-clock invalid argument");
         }
-        else if (L"4k" == bitrate)
+    }
+
+    if (auto echo = ParseArgument(L"-echo", args))
+    {
+        if (L"full" == echo)
         {
-            config.m_bitrate = Configuration::c_bitrate4K;
+            config.m_echoMode = EchoMode::Full;
         }
-        else if (L"test" == bitrate)
+        else if (L"header" == echo)
         {
-            config.m_bitrate = Configuration::c_testBitrate;
+            config.m_echoMode = EchoMode::Header;
         }
         else
         {
-            // Convert from mb/s to b/s
-            const auto bitrateInMbs = integer_cast<unsigned long>(*bitrate);
-            if (bitrateInMbs < 1)
+            throw std::invalid_argument("-echo invalid argument");
+        }
+
+        // The client sends full datagrams: only the server chooses what it echoes
+        if (config.m_listenAddress.family() == AF_UNSPEC)
+        {
+            throw std::invalid_argument("-echo is only supported in server mode");
+        }
+    }
+
+    if (auto offload = ParseArgument(L"-offload", args))
+    {
+        config.m_udpOffload = (integer_cast<unsigned long>(*offload) != 0);
+    }
+
+    if (auto autotune = ParseArgument(L"-autotune", args))
+    {
+        config.m_autotune = (integer_cast<unsigned long>(*autotune) != 0);
+    }
+
+    if (auto overrun = ParseArgument(L"-overrun", args))
+    {
+        config.m_timerOverrunPolicy = ParseOverrunPolicy(*overrun);
+    }
+
+    if (auto predictor = ParseArgument(L"-predictor", args))
+    {
+        if (L"ewma" == predictor)
+        {
+            config.m_predictorModel = PredictorModel::Ewma;
+        }
+        else if (L"kalman" == predictor)
+        {
+            config.m_predictorModel = PredictorModel::Kalman;
+        }
+        else
+        {
+            throw std::invalid_argument("-predictor invalid argument");
+        }
+    }
+
+    if (auto deadlines = ParseArgument(L"-deadlines", args))
+    {
+        config.m_deadlines.clear();
+        for (const auto deadline : std::views::split(*deadlines, L','))
+        {
+            config.m_deadlines.push_back(integer_cast<unsigned long>(std::wstring_view{deadline.begin(), deadline.end()}));
+            if (config.m_deadlines.back() < 1)
             {
-                throw std::invalid_argument("-bitrate invalid argument");
+                throw std::invalid_argument("-deadlines invalid argument");
             }
-            config.m_bitrate = bitrateInMbs * 1024 * 1024;
         }
     }
 
-    if (auto grouping = ParseArgument(L"-grouping", args))
+    if (auto search = ParseArgument(L"-search", args))
     {
-        config.m_grouping = integer_cast<unsigned long>(*grouping);
-        if (config.m_grouping < 1)
+        if (config.m_targetAddress.family() == AF_UNSPEC)
         {
-            throw std::invalid_argument("-grouping invalid argument");
+            throw std::invalid_argument("-search requires -target");
+        }
+
+        config.m_searchCapacity = true;
+        if (L"binary" == search)
+        {
+            config.m_capacitySearch.m_algorithm = CapacitySearchAlgorithm::Binary;
+        }
+        else if (L"aimd" == search)
+        {
+            config.m_capacitySearch.m_algorithm = CapacitySearchAlgorithm::Aimd;
+        }
+        else
+        {
+            throw std::invalid_argument("-search invalid argument");
         }
     }
 
-    if (auto duration = ParseArgument(L"-duration", args))
+    if (auto searchRange = ParseArgument(L"-searchrange", args))
     {
-        config.m_duration = integer_cast<unsigned long>(*duration);
-        if (config.m_duration < 1)
+        std::vector<unsigned long> bitratesInMbs;
+        for (const auto bitrate : std::views::split(*searchRange, L','))
         {
-            throw std::invalid_argument("-duration invalid argument");
+            bitratesInMbs.push_back(integer_cast<unsigned long>(std::wstring_view{bitrate.begin(), bitrate.end()}));
         }
+        if (bitratesInMbs.size() != 2 || bitratesInMbs[0] < 1 || bitratesInMbs[1] < bitratesInMbs[0])
+        {
+            throw std::invalid_argument("-searchrange invalid argument");
+        }
+
+        // Convert from mb/s to b/s
+        config.m_capacitySearch.m_minBitRate = bitratesInMbs[0] * 1024 * 1024;
+        config.m_capacitySearch.m_maxBitRate = bitratesInMbs[1] * 1024 * 1024;
     }
 
-    if (auto prepostRecvs = ParseArgument(L"-prepostrecvs", args))
+    if (auto searchLoss = ParseArgument(L"-searchloss", args))
     {
-        config.m_prePostRecvs = integer_cast<unsigned long>(*prepostRecvs);
-        if (config.m_prePostRecvs < 1)
+        config.m_capacitySearch.m_maxLoss = integer_cast<unsigned long>(*searchLoss);
+        if (config.m_capacitySearch.m_maxLoss > 100)
         {
-            throw std::invalid_argument("-prepostrecvs invalid argument");
+            throw std::invalid_argument("-searchloss invalid argument");
+        }
+    }
+
+    if (auto searchLatency = ParseArgument(L"-searchlatency", args))
+    {
+        config.m_capacitySearch.m_maxLatency = integer_cast<unsigned long>(*searchLatency);
+        if (config.m_capacitySearch.m_maxLatency < 1)
+        {
+            throw std::invalid_argument("-searchlatency invalid argument");
+        }
+    }
+
+    if (auto searchTrial = ParseArgument(L"-searchtrial", args))
+    {
+        config.m_capacitySearch.m_trialDuration = integer_cast<unsigned long>(*searchTrial);
+        if (config.m_capacitySearch.m_trialDuration < 1)
+        {
+            throw std::invalid_argument("-searchtrial invalid argument");
+        }
+    }
+
+    if (auto bandwidth = ParseArgument(L"-bandwidth", args))
+    {
+        config.m_probeBandwidth = (integer_cast<unsigned long>(*bandwidth) != 0);
+        if (config.m_probeBandwidth && config.m_targetAddress.family() == AF_UNSPEC)
+        {
+            throw std::invalid_argument("-bandwidth requires -target");
+        }
+    }
+
+    if (auto trainLength = ParseArgument(L"-trainlength", args))
+    {
+        config.m_bandwidthProbe.m_trainLength = integer_cast<unsigned long>(*trainLength);
+        if (config.m_bandwidthProbe.m_trainLength < 2)
+        {
+            throw std::invalid_argument("-trainlength invalid argument");
+        }
+    }
+
+    // After the options giving the default settings of the phases
+    if (auto scenario = ParseArgument(L"-scenario", args))
+    {
+        if (config.m_targetAddress.family() == AF_UNSPEC)
+        {
+            throw std::invalid_argument("-scenario requires -target");
+        }
+
+        config.m_scenarioFile = *scenario;
+        if (!std::filesystem::exists(config.m_scenarioFile))
+        {
+            throw std::invalid_argument("-scenario invalid argument");
+        }
+        config.m_scenario = LoadScenario(config.m_scenarioFile, config);
+    }
+
+    if (auto load = ParseArgument(L"-load", args))
+    {
+        config.m_loadFlow = true;
+        if (L"primary" == load)
+        {
+            config.m_loadSecondaryInterface = false;
+        }
+        else if (L"secondary" == load)
+        {
+            config.m_loadSecondaryInterface = true;
+        }
+        else
+        {
+            throw std::invalid_argument("-load invalid argument");
+        }
+    }
+
+    if (auto loadRate = ParseArgument(L"-loadrate", args))
+    {
+        // Convert from mb/s to b/s
+        const auto loadRateInMbs = integer_cast<unsigned long>(*loadRate);
+        if (loadRateInMbs < 1)
+        {
+            throw std::invalid_argument("-loadrate invalid argument");
         }
+        config.m_loadBitrate = loadRateInMbs * 1024 * 1024;
+    }
+
+    if (auto classes = ParseArgument(L"-classes", args))
+    {
+        for (const auto trafficClass : std::views::split(*classes, L','))
+        {
+            const std::wstring_view className{trafficClass.begin(), trafficClass.end()};
+            if (L"vo" == className)
+            {
+                config.m_trafficClasses.push_back(TrafficClass::Voice);
+            }
+            else if (L"vi" == className)
+            {
+                config.m_trafficClasses.push_back(TrafficClass::Video);
+            }
+            else if (L"be" == className)
+            {
+                config.m_trafficClasses.push_back(TrafficClass::BestEffort);
+            }
+            else if (L"bk" == className)
+            {
+                config.m_trafficClasses.push_back(TrafficClass::Background);
+            }
+            else
+            {
+                throw std::invalid_argument("-classes invalid argument");
+            }
+        }
+    }
+
+    if (auto flows = ParseArgument(L"-flows", args))
+    {
+        config.m_flows = integer_cast<unsigned long>(*flows);
+        if (config.m_flows < 1 || config.m_flows > Configuration::c_maxFlows)
+        {
+            throw std::invalid_argument("-flows invalid argument");
+        }
+        if (config.m_flows > 1 && !config.m_trafficClasses.empty())
+        {
+            throw std::invalid_argument("-flows cannot be combined with -classes");
+        }
+    }
+
+    if (auto ecn = ParseArgument(L"-ecn", args))
+    {
+        if (L"ect0" == ecn)
+        {
+            config.m_ecnCodepoint = EcnCodepoint::Ect0;
+        }
+        else if (L"ect1" == ecn)
+        {
+            config.m_ecnCodepoint = EcnCodepoint::Ect1;
+        }
+        else
+        {
+            throw std::invalid_argument("-ecn invalid argument");
+        }
+    }
+
+    if (auto frames = ParseArgument(L"-frames", args))
+    {
+        config.m_frameMetrics = (integer_cast<unsigned long>(*frames) != 0);
     }
 
     if (auto secondary = ParseArgument(L"-secondary", args))
@@ -287,6 +881,56 @@ Configuration ParseArguments(std::vector<const wchar_t*>& args)
         SetLogLevel(static_cast<LogLevel>(logLevelAsInt));
     }
 
+    // The capacity search sends on its own terms, one interface at a time
+    if (config.m_searchCapacity)
+    {
+        if (config.m_probeBandwidth || !config.m_scenario.empty())
+        {
+            throw std::invalid_argument("only one of -search, -bandwidth and -scenario can be specified");
+        }
+        if (!config.m_trafficClasses.empty() || config.m_flows > 1 || config.m_frameMetrics || config.m_loadFlow ||
+            config.m_ecnCodepoint != EcnCodepoint::NotEct)
+        {
+            throw std::invalid_argument("-search cannot be combined with -classes, -flows, -frames, -load or -ecn");
+        }
+    }
+
+    // The bandwidth probe sends its own packet pairs and trains on the path sockets
+    if (config.m_probeBandwidth)
+    {
+        if (!config.m_scenario.empty())
+        {
+            throw std::invalid_argument("only one of -search, -bandwidth and -scenario can be specified");
+        }
+        if (!config.m_trafficClasses.empty() || config.m_flows > 1 || config.m_frameMetrics || config.m_loadFlow ||
+            config.m_ecnCodepoint != EcnCodepoint::NotEct)
+        {
+            throw std::invalid_argument("-bandwidth cannot be combined with -classes, -flows, -frames, -load or -ecn");
+        }
+    }
+
+    // The phases only mark their datagrams with -ecn, the other measures are those of a single run
+    if (!config.m_scenario.empty() &&
+        (!config.m_trafficClasses.empty() || config.m_flows > 1 || config.m_frameMetrics || config.m_loadFlow))
+    {
+        throw std::invalid_argument("-scenario cannot be combined with -classes, -flows, -frames or -load");
+    }
+
+    const auto measureAllAddresses =
+        config.m_addressSelection == AddressSelection::All &&
+        std::ranges::any_of(config.m_resolvedTargetAddresses, [](const auto& resolvedAddresses) { return resolvedAddresses.size() > 1; });
+    if (!config.m_additionalTargetAddresses.empty() || measureAllAddresses)
+    {
+        if (config.m_searchCapacity || config.m_probeBandwidth || !config.m_scenario.empty())
+        {
+            throw std::invalid_argument("several targets are only supported in client mode");
+        }
+        if (!config.m_trafficClasses.empty() || config.m_flows > 1)
+        {
+            throw std::invalid_argument("several targets cannot be combined with -classes or -flows");
+        }
+    }
+
     if (!args.empty())
     {
         throw std::invalid_argument("Unknown arguments");
@@ -304,35 +948,207 @@ void RunServerMode(Configuration& config)
 
     Log<LogLevel::Output>("Starting the echo server...\n");
 
-    StreamServer server(config.m_listenAddress);
+    StreamServer server(config.m_listenAddress, config.m_udpOffload, config.m_echoMode);
     server.Start(config.m_prePostRecvs);
 
     Log<LogLevel::Output>("Ready to echo data\n");
 
-    // Sleep until the program is interrupted with Ctrl-C
-    Sleep(INFINITE);
+    // Run until the program is interrupted with Ctrl-C, reporting datagrams dropped by the host receive queues:
+    // the client would otherwise count them as lost in the network
+    constexpr DWORD autotuneInterval = 1000; // 1 sec
+    constexpr DWORD statusInterval = 10000;  // 10 sec
+    long long reportedHostReceiveDrops = 0;
+    std::array<long long, 2> reportedEchoedDatagrams{};
+    for (DWORD elapsed = autotuneInterval;; elapsed += autotuneInterval)
+    {
+        Sleep(autotuneInterval);
+
+        if (config.m_autotune)
+        {
+            server.Autotune();
+        }
+
+        if (elapsed % statusInterval != 0)
+        {
+            continue;
+        }
+
+        const auto echoedDatagrams = std::array{server.GetEchoedDatagrams(AF_INET), server.GetEchoedDatagrams(AF_INET6)};
+        if (echoedDatagrams != reportedEchoedDatagrams)
+        {
+            Log<LogLevel::Output>(
+                "%lld IPv4 and %lld IPv6 datagrams echoed since the server started\n", echoedDatagrams[0], echoedDatagrams[1]);
+            reportedEchoedDatagrams = echoedDatagrams;
+        }
+
+        const auto hostReceiveDrops = server.GetHostReceiveDrops();
+        if (hostReceiveDrops != reportedHostReceiveDrops)
+        {
+            if (server.IsDualMode())
+            {
+                Log<LogLevel::Output>(
+                    "%lld datagrams dropped by the server host UDP receive queues since the server started (IPv4: %lld, IPv6: %lld)\n",
+                    hostReceiveDrops,
+                    server.GetHostReceiveDrops(AF_INET),
+                    server.GetHostReceiveDrops(AF_INET6));
+            }
+            else
+            {
+                Log<LogLevel::Output>(
+                    "%lld datagrams dropped by the server host UDP receive queues since the server started\n", hostReceiveDrops);
+            }
+            reportedHostReceiveDrops = hostReceiveDrops;
+        }
+    }
+}
+
+void RunReplayMode(const Configuration& config)
+{
+    Log<LogLevel::Output>("Loading the latency data...\n");
+    std::ifstream file{config.m_replayFile};
+    auto latencyData = LoadLatencyData(file);
+    latencyData.m_datagramSize = c_datagramMaxSize;
+
+    Log<LogLevel::Output>("Replaying the scheduling policies...\n");
+    const auto trace = BuildReplayTrace(latencyData);
+    const auto policies = CreateDefaultReplayPolicies();
+    PrintReplayResults(trace, ReplayPolicies(trace, policies));
+}
+
+// Probe all the addresses of the targets that resolved to several, then replace the first resolved addresses picked by
+// ParseArguments with the fastest address of each target, or with all of them sorted by handshake round-trip time
+void SelectTargetAddresses(Configuration& config)
+{
+    if (config.m_addressSelection == AddressSelection::First)
+    {
+        return;
+    }
+
+    std::vector<ctl::ctSockaddr> probedAddresses;
+    for (auto& resolvedAddresses : config.m_resolvedTargetAddresses)
+    {
+        for (auto& address : resolvedAddresses)
+        {
+            if (address.port() == 0)
+            {
+                address.SetPort(config.m_port);
+            }
+        }
+        if (resolvedAddresses.size() > 1)
+        {
+            probedAddresses.insert(probedAddresses.end(), resolvedAddresses.begin(), resolvedAddresses.end());
+        }
+    }
+    if (probedAddresses.empty())
+    {
+        return;
+    }
+
+    Log<LogLevel::Output>("Probing %zu target addresses...\n", probedAddresses.size());
+    const auto roundTripTimes = StreamClient::ProbeTargetAddresses(probedAddresses);
+    for (size_t i = 0; i < probedAddresses.size(); ++i)
+    {
+        if (roundTripTimes[i] < 0)
+        {
+            Log<LogLevel::Output>("%ls: unreachable\n", probedAddresses[i].WriteCompleteAddress().c_str());
+        }
+        else
+        {
+            Log<LogLevel::Output>(
+                "%ls: handshake round-trip time %.2f ms\n",
+                probedAddresses[i].WriteCompleteAddress().c_str(),
+                ConvertNanosToMillis(roundTripTimes[i]));
+        }
+    }
+
+    config.m_targetAddress = ctl::ctSockaddr{};
+    config.m_additionalTargetAddresses.clear();
+    size_t probed = 0;
+    for (const auto& resolvedAddresses : config.m_resolvedTargetAddresses)
+    {
+        std::vector<size_t> order(resolvedAddresses.size());
+        std::iota(order.begin(), order.end(), size_t{0});
+        if (resolvedAddresses.size() > 1)
+        {
+            // The reachable addresses by increasing round-trip time, then the unreachable ones in the resolver order
+            auto roundTripTime = [&](size_t i) {
+                const auto probedRoundTripTime = roundTripTimes[probed + i];
+                return probedRoundTripTime < 0 ? LLONG_MAX : probedRoundTripTime;
+            };
+            std::ranges::stable_sort(order, {}, roundTripTime);
+            probed += resolvedAddresses.size();
+        }
+
+        const auto selectedCount = config.m_addressSelection == AddressSelection::All ? order.size() : 1;
+        for (size_t i = 0; i < selectedCount; ++i)
+        {
+            const auto& address = resolvedAddresses[order[i]];
+            if (config.m_targetAddress.family() == AF_UNSPEC)
+            {
+                config.m_targetAddress = address;
+            }
+            else
+            {
+                config.m_additionalTargetAddresses.push_back(address);
+            }
+            Log<LogLevel::Output>("Selected target address %ls\n", address.WriteCompleteAddress().c_str());
+        }
+    }
 }
 
 void RunClientMode(Configuration& config)
 {
+    SelectTargetAddresses(config);
     if (config.m_targetAddress.port() == 0)
     {
         config.m_targetAddress.SetPort(config.m_port);
     }
+    for (auto& targetAddress : config.m_additionalTargetAddresses)
+    {
+        if (targetAddress.port() == 0)
+        {
+            targetAddress.SetPort(config.m_port);
+        }
+    }
 
     // must have this handle open until we are done to keep the secondary STA port active
     wil::unique_wlan_handle wlanHandle;
     wil::unique_event completionEvent(wil::EventOptions::ManualReset);
 
     Log<LogLevel::Output>("Starting connection setup...\n");
-    StreamClient client(config.m_targetAddress, config.m_prePostRecvs, completionEvent.get());
+    StreamClient client(config.m_targetAddress, config.m_prePostRecvs, config.m_udpOffload, config.m_autotune, completionEvent.get());
     if (config.m_useSecondaryWlanInterface)
     {
         client.RequestSecondaryWlanConnection();
     }
+    if (!config.m_trafficClasses.empty())
+    {
+        client.EnableTrafficClasses(config.m_trafficClasses);
+    }
+    if (config.m_flows > 1)
+    {
+        client.EnableFlows(config.m_flows);
+    }
+    if (!config.m_additionalTargetAddresses.empty())
+    {
+        client.EnableTargets(config.m_additionalTargetAddresses);
+    }
+    if (config.m_ecnCodepoint != EcnCodepoint::NotEct)
+    {
+        client.EnableEcn(config.m_ecnCodepoint);
+    }
+    if (config.m_frameMetrics)
+    {
+        client.EnableFrameMetrics();
+    }
+    if (config.m_loadFlow)
+    {
+        client.EnableLoadFlow(
+            config.m_loadSecondaryInterface ? StreamClient::Interface::Secondary : StreamClient::Interface::Primary, config.m_loadBitrate);
+    }
 
     Log<LogLevel::Output>("Start transmitting data...\n");
-    client.Start(config.m_bitrate, config.m_grouping, config.m_duration);
+    client.Start(config.m_bitrate, config.m_grouping, config.m_duration, config.m_timerOverrunPolicy, config.m_predictorModel);
 
     // wait for twice as long as the duration
     if (!completionEvent.wait(config.m_duration * 2 * 1000))
@@ -342,7 +1158,91 @@ void RunClientMode(Configuration& config)
     }
 
     Log<LogLevel::Output>("Transmission complete\n");
-    client.PrintStatistics();
+    client.PrintStatistics(config.m_deadlines);
+
+    if (!config.m_outputFile.empty())
+    {
+        Log<LogLevel::Output>("Dumping data to file...\n");
+        std::ofstream file{config.m_outputFile};
+        client.DumpLatencyData(file);
+        file.close();
+    }
+}
+
+void RunCapacitySearchMode(Configuration& config)
+{
+    SelectTargetAddresses(config);
+    if (config.m_targetAddress.port() == 0)
+    {
+        config.m_targetAddress.SetPort(config.m_port);
+    }
+
+    wil::unique_event completionEvent(wil::EventOptions::ManualReset);
+
+    Log<LogLevel::Output>("Starting connection setup...\n");
+    StreamClient client(config.m_targetAddress, config.m_prePostRecvs, config.m_udpOffload, config.m_autotune, completionEvent.get());
+    if (config.m_useSecondaryWlanInterface)
+    {
+        client.RequestSecondaryWlanConnection();
+    }
+
+    Log<LogLevel::Output>("Start searching capacity...\n");
+    client.SearchCapacity(config.m_capacitySearch, config.m_grouping, config.m_timerOverrunPolicy, config.m_predictorModel);
+
+    Log<LogLevel::Output>("Capacity search complete\n");
+    client.PrintCapacitySearchResults();
+}
+
+void RunBandwidthProbeMode(Configuration& config)
+{
+    SelectTargetAddresses(config);
+    if (config.m_targetAddress.port() == 0)
+    {
+        config.m_targetAddress.SetPort(config.m_port);
+    }
+
+    wil::unique_event completionEvent(wil::EventOptions::ManualReset);
+
+    Log<LogLevel::Output>("Starting connection setup...\n");
+    StreamClient client(config.m_targetAddress, config.m_prePostRecvs, config.m_udpOffload, config.m_autotune, completionEvent.get());
+    if (config.m_useSecondaryWlanInterface)
+    {
+        client.RequestSecondaryWlanConnection();
+    }
+
+    Log<LogLevel::Output>("Start probing bandwidth...\n");
+    client.ProbeBandwidth(config.m_bandwidthProbe, config.m_predictorModel);
+
+    Log<LogLevel::Output>("Bandwidth probe complete\n");
+    client.PrintBandwidthEstimates();
+}
+
+void RunScenarioMode(Configuration& config)
+{
+    SelectTargetAddresses(config);
+    if (config.m_targetAddress.port() == 0)
+    {
+        config.m_targetAddress.SetPort(config.m_port);
+    }
+
+    wil::unique_event completionEvent(wil::EventOptions::ManualReset);
+
+    Log<LogLevel::Output>("Starting connection setup...\n");
+    StreamClient client(config.m_targetAddress, config.m_prePostRecvs, config.m_udpOffload, config.m_autotune, completionEvent.get());
+    if (config.m_useSecondaryWlanInterface)
+    {
+        client.RequestSecondaryWlanConnection();
+    }
+    if (config.m_ecnCodepoint != EcnCodepoint::NotEct)
+    {
+        client.EnableEcn(config.m_ecnCodepoint);
+    }
+
+    Log<LogLevel::Output>("Start running the scenario...\n");
+    client.RunScenario(config.m_scenario, config.m_predictorModel);
+
+    Log<LogLevel::Output>("Scenario complete\n");
+    client.PrintScenarioResults(config.m_deadlines);
 
     if (!config.m_outputFile.empty())
     {
@@ -396,27 +1296,124 @@ try
 
     Configuration config = ParseArguments(args);
 
-    if (config.m_listenAddress.family() != AF_UNSPEC)
+    if (config.m_useTscClock && !EnableTscClock())
+    {
+        Log<LogLevel::Output>("The processor does not have an invariant TSC, using QPC to timestamp datagrams\n");
+    }
+
+    if (!config.m_replayFile.empty())
+    {
+        std::cout << "--- Replay Mode ---\n";
+        std::wcout << L"Latency data: " << config.m_replayFile.wstring() << L'\n';
+        std::cout << "-------------------\n\n";
+
+        RunReplayMode(config);
+    }
+    else if (config.m_listenAddress.family() != AF_UNSPEC)
     {
         // Start the server if "-listen" is specified
         std::cout << "--- Server Mode ---\n";
         std::wcout << L"Port: " << config.m_port << L'\n';
-        std::wcout << L"Listen Address: " << config.m_listenAddress.WriteCompleteAddress() << L'\n';
+        std::wcout << L"Listen Address: " << config.m_listenAddress.WriteCompleteAddress();
+        if (config.m_listenAddress.family() == AF_INET6 && config.m_listenAddress.IsAddressAny())
+        {
+            std::wcout << L" (IPv4 and IPv6)";
+        }
+        std::wcout << L'\n';
+        std::wcout << L"Echo: " << (config.m_echoMode == EchoMode::Header ? L"headers only" : L"full datagrams") << L'\n';
         std::wcout << L"Number of receive buffers: " << config.m_prePostRecvs << L'\n';
+        std::wcout << L"UDP offload: " << (config.m_udpOffload ? L"enabled" : L"disabled") << L'\n';
+        std::wcout << L"Autotuning: " << (config.m_autotune ? L"enabled" : L"disabled") << L'\n';
         std::cout << "-------------------\n\n";
 
         RunServerMode(config);
     }
+    else if (config.m_searchCapacity)
+    {
+        const auto& search = config.m_capacitySearch;
+        std::cout << "--- Capacity Search Mode ---\n";
+        std::wcout << L"Port: " << config.m_port << L'\n';
+        std::wcout << L"Target Address: " << config.m_targetAddress.WriteCompleteAddress() << L'\n';
+        std::wcout << L"Algorithm: " << (search.m_algorithm == CapacitySearchAlgorithm::Binary ? L"binary" : L"aimd") << L'\n';
+        std::wcout << L"Bitrate range: " << search.m_minBitRate << L" to " << search.m_maxBitRate << L" bits per second\n";
+        std::wcout << L"Loss budget: " << search.m_maxLoss << L"%\n";
+        std::wcout << L"Latency budget (99th percentile): " << search.m_maxLatency << L" ms\n";
+        std::wcout << L"Trial duration: " << search.m_trialDuration << L" seconds\n";
+        std::wcout << L"Datagram grouping: " << config.m_grouping << L'\n';
+        std::wcout << L"Number of receive buffers: " << config.m_prePostRecvs << L'\n';
+        std::wcout << L"UDP offload: " << (config.m_udpOffload ? L"enabled" : L"disabled") << L'\n';
+        std::wcout << L"Autotuning: " << (config.m_autotune ? L"enabled" : L"disabled") << L'\n';
+        std::cout << "----------------------------\n\n";
+
+        RunCapacitySearchMode(config);
+    }
+    else if (config.m_probeBandwidth)
+    {
+        std::cout << "--- Bandwidth Probe Mode ---\n";
+        std::wcout << L"Port: " << config.m_port << L'\n';
+        std::wcout << L"Target Address: " << config.m_targetAddress.WriteCompleteAddress() << L'\n';
+        std::wcout << L"Packet pairs: " << config.m_bandwidthProbe.m_pairCount << L'\n';
+        std::wcout << L"Packet trains: " << config.m_bandwidthProbe.m_trainCount << L" of " << config.m_bandwidthProbe.m_trainLength
+                   << L" datagrams\n";
+        std::wcout << L"Number of receive buffers: " << config.m_prePostRecvs << L'\n';
+        std::wcout << L"UDP offload: " << (config.m_udpOffload ? L"enabled" : L"disabled") << L'\n';
+        std::cout << "----------------------------\n\n";
+
+        RunBandwidthProbeMode(config);
+    }
+    else if (!config.m_scenario.empty())
+    {
+        constexpr const wchar_t* sendNames[] = {L"both interfaces", L"primary interface", L"secondary interface"};
+        std::cout << "--- Scenario Mode ---\n";
+        std::wcout << L"Port: " << config.m_port << L'\n';
+        std::wcout << L"Target Address: " << config.m_targetAddress.WriteCompleteAddress() << L'\n';
+        std::wcout << L"Scenario: " << config.m_scenarioFile.wstring() << L'\n';
+        for (const auto& phase : config.m_scenario)
+        {
+            std::wcout << L"Phase " << phase.m_name << L": " << phase.m_bitRate << L" bits per second, grouping "
+                       << phase.m_grouping << L", " << phase.m_duration << L" seconds, on "
+                       << sendNames[static_cast<size_t>(phase.m_duplication)] << L'\n';
+        }
+        std::wcout << L"Number of receive buffers: " << config.m_prePostRecvs << L'\n';
+        std::wcout << L"UDP offload: " << (config.m_udpOffload ? L"enabled" : L"disabled") << L'\n';
+        std::wcout << L"Autotuning: " << (config.m_autotune ? L"enabled" : L"disabled") << L'\n';
+        std::cout << "---------------------\n\n";
+
+        RunScenarioMode(config);
+    }
     else
     {
         // Start a client if "-target" is specified
         std::cout << "--- Client Mode ---\n";
         std::wcout << L"Port: " << config.m_port << L'\n';
         std::wcout << L"Target Address: " << config.m_targetAddress.WriteCompleteAddress() << L'\n';
+        for (const auto& targetAddress : config.m_additionalTargetAddresses)
+        {
+            std::wcout << L"Target Address: " << targetAddress.WriteCompleteAddress() << L'\n';
+        }
         std::wcout << L"Bitrate: " << config.m_bitrate << L" bits per second\n";
         std::wcout << L"Datagram grouping: " << config.m_grouping << L'\n';
         std::wcout << L"Duration: " << config.m_duration << L" seconds\n";
+        if (!config.m_trafficClasses.empty())
+        {
+            std::wcout << L"Traffic classes:";
+            for (const auto trafficClass : config.m_trafficClasses)
+            {
+                std::wcout << L' ' << GetTrafficClassName(trafficClass);
+            }
+            std::wcout << L'\n';
+        }
+        if (config.m_flows > 1)
+        {
+            std::wcout << L"Flows per interface: " << config.m_flows << L'\n';
+        }
+        if (config.m_ecnCodepoint != EcnCodepoint::NotEct)
+        {
+            std::wcout << L"ECN codepoint: " << (config.m_ecnCodepoint == EcnCodepoint::Ect0 ? L"ECT(0)" : L"ECT(1)") << L'\n';
+        }
         std::wcout << L"Number of receive buffers: " << config.m_prePostRecvs << L'\n';
+        std::wcout << L"UDP offload: " << (config.m_udpOffload ? L"enabled" : L"disabled") << L'\n';
+        std::wcout << L"Autotuning: " << (config.m_autotune ? L"enabled" : L"disabled") << L'\n';
         std::cout << "-------------------\n\n";
 
         RunClientMode(config);
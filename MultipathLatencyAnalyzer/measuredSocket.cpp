@@ -6,17 +6,34 @@
 #include "adapters.h"
 #include "datagram.h"
 #include "logs.h"
+#include "monotonic_clock.h"
 #include "socket_utils.h"
-#include "time_utils.h"
 
 #include <Windows.h>
 #include <winrt/Windows.Networking.Connectivity.h>
 
-namespace multipath {
+#include <algorithm>
 
+namespace multipath {
 namespace {
-    constexpr DWORD c_defaultSocketReceiveBufferSize = 1048576; // 1MB receive buffer
-}
+
+    QOS_TRAFFIC_TYPE GetQosTrafficType(TrafficClass trafficClass) noexcept
+    {
+        switch (trafficClass)
+        {
+        case TrafficClass::Background:
+            return QOSTrafficTypeBackground;
+        case TrafficClass::Video:
+            return QOSTrafficTypeAudioVideo;
+        case TrafficClass::Voice:
+            return QOSTrafficTypeVoice;
+        case TrafficClass::BestEffort:
+        default:
+            return QOSTrafficTypeBestEffort;
+        }
+    }
+
+} // namespace
 
 MeasuredSocket::~MeasuredSocket() noexcept
 {
@@ -24,18 +41,104 @@ MeasuredSocket::~MeasuredSocket() noexcept
     Cancel();
 }
 
-void MeasuredSocket::Setup(const ctl::ctSockaddr& targetAddress, int numReceivedBuffers, int interfaceIndex)
+void MeasuredSocket::SetTrafficClass(TrafficClass trafficClass) noexcept
+{
+    m_trafficClass = trafficClass;
+}
+
+void MeasuredSocket::SetEcnCodepoint(EcnCodepoint ecnCodepoint) noexcept
+{
+    m_ecnCodepoint = ecnCodepoint;
+}
+
+void MeasuredSocket::SetSequenceStride(long long stride) noexcept
+{
+    m_sequenceStride = stride;
+}
+
+void MeasuredSocket::SharePathStatistics(const MeasuredSocket& pathSocket) noexcept
+{
+    m_roundTripTimes = pathSocket.m_roundTripTimes;
+    m_sharesPathStatistics = true;
+    m_pathPredictor.reset();
+}
+
+void MeasuredSocket::Setup(const ctl::ctSockaddr& targetAddress, int numReceivedBuffers, bool udpOffload, int interfaceIndex)
 {
     auto lock = m_lock.lock();
 
-    m_socket.reset(CreateDatagramSocket());
-    SetSocketReceiveBufferSize(m_socket.get(), c_defaultSocketReceiveBufferSize);
+    m_socket.reset(CreateDatagramSocket(targetAddress.family()));
+    m_qosHandle.reset();
+    m_socketBufferSize = c_defaultSocketBufferSize;
+    SetSocketReceiveBufferSize(m_socket.get(), m_socketBufferSize);
+    SetSocketSendBufferSize(m_socket.get(), m_socketBufferSize);
     SetSocketOutgoingInterface(m_socket.get(), targetAddress.family(), interfaceIndex);
+    m_interfaceIndex = interfaceIndex;
+    m_wsaRecvMsg = GetWsaRecvMsgFunction(m_socket.get());
+
+    // Segmentation offload is the only way to send several datagrams in a single call: use it whenever available.
+    // Receive offload is opt-in, as the datagrams it coalesces share their receive timestamp.
+    m_sendOffloadEnabled = TrySetSocketSendMessageSize(m_socket.get(), c_bufferSize);
+    m_receiveBufferSize = c_bufferSize;
+    if (udpOffload && TrySetSocketReceiveMaxCoalescedSize(m_socket.get(), c_maxCoalescedReceiveSize))
+    {
+        m_receiveBufferSize = c_maxCoalescedReceiveSize;
+    }
+
+    Log<LogLevel::Info>(
+        "UDP segmentation offload is %s, UDP receive offload is %s\n",
+        m_sendOffloadEnabled ? "enabled" : "not supported",
+        m_receiveBufferSize == c_maxCoalescedReceiveSize ? "enabled" : udpOffload ? "not supported" : "disabled");
+
+    m_sendControlLength = 0;
+    if (m_ecnCodepoint != EcnCodepoint::NotEct)
+    {
+        WSAMSG message{};
+        SetEcnControl(message, m_sendControlBuffer, targetAddress.family(), static_cast<int>(m_ecnCodepoint));
+        m_sendControlLength = message.Control.len;
+    }
+
+    // The socket may be setup again after a cancel: start over from the configured number of receives
+    m_receiveStates.clear();
     m_receiveStates.resize(numReceivedBuffers);
+    for (auto& receiveState : m_receiveStates)
+    {
+        receiveState.m_buffer.resize(m_receiveBufferSize);
+    }
+    m_postedReceives = 0;
+    m_receiveStarvations = 0;
+    m_tunedReceiveStarvations = 0;
+    if (!m_sharesPathStatistics)
+    {
+        m_roundTripTimes->Reset();
+    }
+    if (m_pathPredictor)
+    {
+        m_pathPredictor->Reset();
+    }
 
     auto error = WSAConnect(m_socket.get(), targetAddress.sockaddr(), targetAddress.length(), nullptr, nullptr, nullptr, nullptr);
     THROW_LAST_ERROR_IF_MSG(SOCKET_ERROR == error, "WSAConnect failed");
 
+    const ctl::ctSockaddr localAddress{targetAddress.family()};
+    m_localPort = localAddress.SetAddress(m_socket.get()) ? localAddress.port() : 0;
+
+    if (m_trafficClass)
+    {
+        try
+        {
+            m_qosHandle = AddSocketToQosFlow(m_socket.get(), GetQosTrafficType(*m_trafficClass));
+        }
+        catch (...)
+        {
+            // The measures are still valid, but the class is not the one requested
+            LOG_CAUGHT_EXCEPTION_MSG("Failed to mark the socket");
+            Log<LogLevel::Output>(
+                "The %s traffic class could not be applied, its datagrams use the default marking\n",
+                GetTrafficClassName(*m_trafficClass));
+        }
+    }
+
     m_threadpoolIo = std::make_unique<ctl::ctThreadIocp>(m_socket.get());
 }
 
@@ -46,11 +149,12 @@ void MeasuredSocket::Cancel() noexcept
         const auto lock = m_lock.lock();
         m_adapterStatus = AdapterStatus::Disabled;
         m_socket.reset();
+        m_qosHandle.reset();
     }
     m_threadpoolIo.reset();
 }
 
-void MeasuredSocket::PrepareToReceivePing(wil::shared_event pingReceived)
+OVERLAPPED* MeasuredSocket::PrepareToReceivePing(wil::shared_event pingReceived, wil::shared_event receiveCompleted)
 {
     auto lock = m_lock.lock();
     if (!m_socket.is_valid())
@@ -63,7 +167,12 @@ void MeasuredSocket::PrepareToReceivePing(wil::shared_event pingReceived)
     wsabuf.buf = m_receiveStates[0].m_buffer.data();
     wsabuf.len = static_cast<ULONG>(m_receiveStates[0].m_buffer.size());
 
-    auto callback = [pingReceived, this](OVERLAPPED* ov) noexcept {
+    auto callback = [pingReceived, receiveCompleted, this](OVERLAPPED* ov) noexcept {
+        const auto receiveTimestamp = SnapMonotonicNanoSec();
+
+        // Signaled once the lock is released, whichever way the receive completed
+        const auto signalCompletion = wil::scope_exit([&]() noexcept { receiveCompleted.SetEvent(); });
+
         auto lock = m_lock.lock();
         if (!m_socket.is_valid())
         {
@@ -75,10 +184,26 @@ void MeasuredSocket::PrepareToReceivePing(wil::shared_event pingReceived)
         DWORD flags = 0;
         if (!WSAGetOverlappedResult(m_socket.get(), ov, &bytesTransferred, false, &flags))
         {
-            FAIL_FAST_LAST_ERROR_MSG("A ping receive operation failed on socket %zu", m_socket.get());
+            const auto error = WSAGetLastError();
+            if (WSA_OPERATION_ABORTED == error)
+            {
+                Log<LogLevel::Info>("Ping receive canceled on socket %zu\n", m_socket.get());
+                return;
+            }
+            FAIL_FAST_WIN32_MSG(error, "A ping receive operation failed on socket %zu", m_socket.get());
         }
 
-        Log<LogLevel::Info>("Received a ping answer on socket %zu\n", m_socket.get());
+        // Each ping carries its own send timestamp: the round-trip time is right even if an earlier ping was lost
+        if (ValidateBufferLength(bytesTransferred))
+        {
+            const auto& header = ParseDatagramHeader(m_receiveStates[0].m_buffer.data());
+            const auto roundTripTime = receiveTimestamp - header.m_sendTimestamp;
+            m_handshakeRoundTripTime = roundTripTime;
+            m_roundTripTimes->Record(roundTripTime);
+        }
+
+        Log<LogLevel::Info>(
+            "Received a ping answer on socket %zu (round-trip time: %lld us)\n", m_socket.get(), m_handshakeRoundTripTime.load() / 1000);
         pingReceived.SetEvent();
     };
 
@@ -97,6 +222,7 @@ void MeasuredSocket::PrepareToReceivePing(wil::shared_event pingReceived)
             THROW_WIN32_MSG(error, "Failed to initiate a ping receive on socket %zu", m_socket.get());
         }
     }
+    return ov;
 }
 
 void MeasuredSocket::PingEchoServer()
@@ -110,64 +236,182 @@ void MeasuredSocket::PingEchoServer()
     Log<LogLevel::Info>("Sending a ping on socket %zu\n", m_socket.get());
 
     const auto sequenceNumber = -1;
-    DatagramSendRequest sendRequest{sequenceNumber, s_sharedSendBuffer};
-    auto& buffers = sendRequest.GetBuffers();
+    auto* sendBuffer = m_sendRing.Acquire(sequenceNumber);
+    THROW_HR_IF_NULL_MSG(E_NOT_SUFFICIENT_BUFFER, sendBuffer, "No send buffer available to send a ping");
+    auto releaseOnExit = wil::scope_exit([&]() noexcept { DatagramSendRing::Release(*sendBuffer); });
+
+    WSABUF wsabuf;
+    wsabuf.buf = sendBuffer->m_buffer.data();
+    wsabuf.len = static_cast<ULONG>(sendBuffer->m_buffer.size());
+    sendBuffer->GetHeader().m_sendTimestamp = SnapMonotonicNanoSec();
 
     // Synchronous send
     DWORD transmitedBytes = 0;
-    auto error = WSASend(m_socket.get(), buffers.data(), static_cast<DWORD>(buffers.size()), &transmitedBytes, 0, nullptr, nullptr);
+    auto error = WSASend(m_socket.get(), &wsabuf, 1, &transmitedBytes, 0, nullptr, nullptr);
     THROW_LAST_ERROR_IF_MSG(SOCKET_ERROR == error, "Failed to send a ping");
 }
 
 void MeasuredSocket::CheckConnectivity()
 {
     wil::shared_event connectedEvent(wil::EventOptions::ManualReset);
+    wil::shared_event receiveCompletedEvent(wil::EventOptions::ManualReset);
 
-    PrepareToReceivePing(connectedEvent);
+    auto* pingRequest = PrepareToReceivePing(connectedEvent, receiveCompletedEvent);
 
     // Re-send a ping immediately if the network status changes
     using winrt::Windows::Networking::Connectivity::NetworkInformation;
     auto revokeToken =
         NetworkInformation::NetworkStatusChanged(winrt::auto_revoke, [this](const auto&) { PingEchoServer(); });
 
-    // Check connectivity
-    const auto maxPingAttempts = 2;
-    for (auto i = 0; i < maxPingAttempts; ++i)
+    // Check connectivity, retrying with an exponential backoff
+    DWORD pingTimeout = c_initialPingTimeout;
+    if (const auto handshakeRoundTripTime = m_handshakeRoundTripTime.load(); handshakeRoundTripTime > 0)
+    {
+        const auto handshakeRoundTripTimeMs = static_cast<DWORD>(handshakeRoundTripTime / 1'000'000);
+        pingTimeout = std::clamp(2 * handshakeRoundTripTimeMs, c_minPingTimeout, c_maxPingTimeout);
+    }
+
+    DWORD elapsed = 0;
+    while (elapsed < c_connectivityTimeout)
     {
         PingEchoServer();
 
-        // Wait 10sec for the answer, return false on timeout
-        if (connectedEvent.wait(10000))
+        if (connectedEvent.wait(pingTimeout))
         {
             Log<LogLevel::Info>("Connectivity to the server confirmed on socket %zu\n", m_socket.get());
             return;
         }
+
+        elapsed += pingTimeout;
+        pingTimeout = (std::min)(pingTimeout * 2, c_maxPingTimeout);
+    }
+
+    // The ping receive uses the first receive buffer: cancel it and wait for its completion, so that it cannot take an
+    // echo once the datagram receives are posted (an unreachable target is still measured)
+    {
+        const auto lock = m_lock.lock();
+        if (m_socket.is_valid())
+        {
+            CancelIoEx(reinterpret_cast<HANDLE>(m_socket.get()), pingRequest);
+        }
+    }
+    receiveCompletedEvent.wait();
+    if (connectedEvent.is_signaled())
+    {
+        Log<LogLevel::Info>("Connectivity to the server confirmed on socket %zu\n", m_socket.get());
+        return;
     }
 
     Log<LogLevel::Info>("Could not reach the server on socket %zu\n", m_socket.get());
     THROW_WIN32_MSG(ERROR_NOT_CONNECTED, "Could not reach the server on socket %zu", m_socket.get());
 }
 
-void MeasuredSocket::SendDatagram(long long sequenceNumber, std::function<void(const SendResult&)> clientCallback) noexcept
+long long MeasuredSocket::SendDatagrams(
+    long long firstSequenceNumber, long long count, std::function<void(const SendResult&)> clientCallback) noexcept
 {
     auto lock = m_lock.lock();
     if (!m_socket.is_valid())
     {
         Log<LogLevel::Error>("Invalid socket, ignoring send request\n");
-        return;
+        return 0;
+    }
+
+    // With segmentation offload, a single send carries a whole batch of datagrams
+    const long long maxBatchSize = m_sendOffloadEnabled ? static_cast<long long>(c_maxSendBatchSize) : 1LL;
+
+    long long sentDatagrams = 0;
+    SendBatch batch{};
+    for (auto sequenceNumber = firstSequenceNumber; sequenceNumber < firstSequenceNumber + count; ++sequenceNumber)
+    {
+        auto* sendBuffer = m_sendRing.Acquire(sequenceNumber);
+        if (!sendBuffer)
+        {
+            // Only counted: under overload, logging each drop under the lock would slow the sends down further. The
+            // statistics report the drops at the end of the run.
+            m_sendRingDrops += 1;
+            continue;
+        }
+
+        batch.m_buffers[batch.m_count++] = sendBuffer;
+        sentDatagrams += 1;
+        if (static_cast<long long>(batch.m_count) == maxBatchSize)
+        {
+            SendBatchUnderLock(batch, clientCallback);
+            batch = {};
+        }
+    }
+
+    if (batch.m_count > 0)
+    {
+        SendBatchUnderLock(batch, clientCallback);
     }
 
-    DatagramSendRequest sendRequest{sequenceNumber, s_sharedSendBuffer};
-    auto& buffers = sendRequest.GetBuffers();
-    const MeasuredSocket::SendResult sendState{sequenceNumber, sendRequest.GetQpc()};
+    return sentDatagrams;
+}
+
+long long MeasuredSocket::GetSendRingDrops() noexcept
+{
+    auto lock = m_lock.lock();
+    return m_sendRingDrops;
+}
+
+long long MeasuredSocket::GetRoundTripTimePercentile(double percentile) noexcept
+{
+    // The receive completions record the round-trip times under the lock
+    auto lock = m_lock.lock();
+    return m_roundTripTimes->GetPercentile(percentile);
+}
+
+void MeasuredSocket::SetPredictorModel(PredictorModel model) noexcept
+{
+    auto lock = m_lock.lock();
+    if (m_pathPredictor)
+    {
+        m_pathPredictor->SetModel(model);
+    }
+}
 
-    Log<LogLevel::All>("Sending sequence number %lld on socket %zu\n", sequenceNumber, m_socket.get());
+PathPrediction MeasuredSocket::PredictPath() noexcept
+{
+    auto lock = m_lock.lock();
+    return m_pathPredictor ? m_pathPredictor->Predict() : PathPrediction{};
+}
 
-    auto callback = [clientCallback = std::move(clientCallback), this, sendState](OVERLAPPED* ov) noexcept {
+long long MeasuredSocket::GetPredictionErrorPercentile(double percentile) noexcept
+{
+    auto lock = m_lock.lock();
+    return m_pathPredictor ? m_pathPredictor->GetPredictionErrors().GetPercentile(percentile) : 0;
+}
+
+void MeasuredSocket::SendBatchUnderLock(const SendBatch& batch, const std::function<void(const SendResult&)>& clientCallback) noexcept
+{
+    std::array<WSABUF, c_maxSendBatchSize> wsabufs{};
+    for (size_t i = 0; i < batch.m_count; ++i)
+    {
+        wsabufs[i].buf = batch.m_buffers[i]->m_buffer.data();
+        wsabufs[i].len = static_cast<ULONG>(batch.m_buffers[i]->m_buffer.size());
+    }
+
+    Log<LogLevel::All>(
+        "Sending sequence numbers %lld to %lld on socket %zu\n",
+        batch.m_buffers[0]->GetHeader().m_sequenceNumber,
+        batch.m_buffers[batch.m_count - 1]->GetHeader().m_sequenceNumber,
+        m_socket.get());
+
+    auto callback = [clientCallback, this, batch](OVERLAPPED* ov) noexcept {
         try
         {
             auto lock = m_lock.lock();
 
+            // The send is complete, the buffers can be reused
+            std::array<SendResult, c_maxSendBatchSize> sendResults{};
+            for (size_t i = 0; i < batch.m_count; ++i)
+            {
+                const auto& header = batch.m_buffers[i]->GetHeader();
+                sendResults[i] = {header.m_sequenceNumber, header.m_sendTimestamp};
+                DatagramSendRing::Release(*batch.m_buffers[i]);
+            }
+
             if (!m_socket.is_valid())
             {
                 Log<LogLevel::Info>("Send callback canceled\n");
@@ -178,7 +422,10 @@ void MeasuredSocket::SendDatagram(long long sequenceNumber, std::function<void(c
             DWORD flags = 0;
             if (WSAGetOverlappedResult(m_socket.get(), ov, &bytesTransmitted, false, &flags))
             {
-                clientCallback(sendState);
+                for (size_t i = 0; i < batch.m_count; ++i)
+                {
+                    clientCallback(sendResults[i]);
+                }
             }
             else
             {
@@ -190,13 +437,39 @@ void MeasuredSocket::SendDatagram(long long sequenceNumber, std::function<void(c
 
     OVERLAPPED* ov = m_threadpoolIo->new_request(callback);
 
-    auto error = WSASend(m_socket.get(), buffers.data(), static_cast<DWORD>(buffers.size()), nullptr, 0, ov, nullptr);
+    // refresh the timestamps at last possible moment. The stack sends the datagrams of the batch one after the other:
+    // the latency of the last ones includes the wait behind the previous ones, as if they had been sent separately.
+    const auto sendTimestamp = SnapMonotonicNanoSec();
+    for (size_t i = 0; i < batch.m_count; ++i)
+    {
+        batch.m_buffers[i]->GetHeader().m_sendTimestamp = sendTimestamp;
+    }
+
+    auto error = 0;
+    if (m_sendControlLength == 0)
+    {
+        error = WSASend(m_socket.get(), wsabufs.data(), static_cast<DWORD>(batch.m_count), nullptr, 0, ov, nullptr);
+    }
+    else
+    {
+        // The ECN field is set per send, in a control message
+        WSAMSG message{};
+        message.lpBuffers = wsabufs.data();
+        message.dwBufferCount = static_cast<DWORD>(batch.m_count);
+        message.Control.buf = m_sendControlBuffer.data();
+        message.Control.len = m_sendControlLength;
+        error = WSASendMsg(m_socket.get(), &message, 0, nullptr, ov, nullptr);
+    }
     if (SOCKET_ERROR == error)
     {
         error = WSAGetLastError();
         if (WSA_IO_PENDING != error)
         {
             m_threadpoolIo->cancel_request(ov);
+            for (size_t i = 0; i < batch.m_count; ++i)
+            {
+                DatagramSendRing::Release(*batch.m_buffers[i]);
+            }
             FAIL_FAST_WIN32_MSG(error, "Failed to initiate a send operation");
         }
     }
@@ -204,13 +477,70 @@ void MeasuredSocket::SendDatagram(long long sequenceNumber, std::function<void(c
 
 void MeasuredSocket::PrepareToReceive(std::function<void(ReceiveResult&)> clientCallback) noexcept
 {
+    auto lock = m_lock.lock();
+    m_receiveCallback = std::move(clientCallback);
     for (auto& s : m_receiveStates)
     {
-        PrepareToReceiveDatagram(s, clientCallback);
+        PrepareToReceiveDatagram(s);
+    }
+}
+
+void MeasuredSocket::Autotune(unsigned long bitRate, bool hostReceiveDropsIncreased) noexcept
+{
+    auto lock = m_lock.lock();
+    if (!m_socket.is_valid() || m_adapterStatus != AdapterStatus::Ready)
+    {
+        return;
+    }
+
+    // Size the socket buffers after the data in flight during the worst round-trips
+    const auto roundTripTime = m_roundTripTimes->GetPercentile(99.9);
+    const auto bitrateDelayProduct = static_cast<double>(bitRate) / 8 * roundTripTime / c_nanoSecInSecond;
+    const auto socketBufferSize = static_cast<int>(std::clamp(
+        2 * bitrateDelayProduct, static_cast<double>(c_defaultSocketBufferSize), static_cast<double>(c_maxSocketBufferSize)));
+    if (socketBufferSize > m_socketBufferSize)
+    {
+        try
+        {
+            SetSocketReceiveBufferSize(m_socket.get(), socketBufferSize);
+            SetSocketSendBufferSize(m_socket.get(), socketBufferSize);
+            m_socketBufferSize = socketBufferSize;
+            Log<LogLevel::Info>(
+                "Socket buffers set to %d kB on socket %zu (99.9th percentile RTT: %lld us)\n",
+                socketBufferSize / 1024,
+                m_socket.get(),
+                roundTripTime / 1000);
+        }
+        catch (...)
+        {
+            LOG_CAUGHT_EXCEPTION_MSG("Failed to grow the socket buffers");
+        }
+    }
+
+    // Post more receives when the completions could not keep up
+    const auto receivesStarved = m_receiveStarvations > m_tunedReceiveStarvations;
+    m_tunedReceiveStarvations = m_receiveStarvations;
+    if ((receivesStarved || hostReceiveDropsIncreased) && m_receiveStates.size() < c_maxReceiveDepth)
+    {
+        const auto receiveDepth = (std::min)(m_receiveStates.size() * 2, c_maxReceiveDepth);
+        while (m_receiveStates.size() < receiveDepth)
+        {
+            auto& receiveState = m_receiveStates.emplace_back();
+            receiveState.m_buffer.resize(m_receiveBufferSize);
+            PrepareToReceiveDatagram(receiveState);
+        }
+
+        Log<LogLevel::Info>("%zu receives posted on socket %zu\n", receiveDepth, m_socket.get());
     }
 }
 
-void MeasuredSocket::PrepareToReceiveDatagram(ReceiveState& receiveState, std::function<void(ReceiveResult&)> clientCallback) noexcept
+MeasuredSocket::TuningState MeasuredSocket::GetTuningState() noexcept
+{
+    auto lock = m_lock.lock();
+    return {.m_socketBufferSize{m_socketBufferSize}, .m_receiveDepth{m_receiveStates.size()}};
+}
+
+void MeasuredSocket::PrepareToReceiveDatagram(ReceiveState& receiveState) noexcept
 {
     auto lock = m_lock.lock();
 
@@ -220,17 +550,27 @@ void MeasuredSocket::PrepareToReceiveDatagram(ReceiveState& receiveState, std::f
         return;
     }
 
-    DWORD flags = 0;
-    WSABUF wsabuf;
-    wsabuf.buf = receiveState.m_buffer.data();
-    wsabuf.len = static_cast<ULONG>(receiveState.m_buffer.size());
+    receiveState.m_wsabuf.buf = receiveState.m_buffer.data();
+    receiveState.m_wsabuf.len = static_cast<ULONG>(receiveState.m_buffer.size());
+
+    // WSARecvMsg reports the size of the datagrams coalesced by receive offload in a control message
+    receiveState.m_message = {};
+    receiveState.m_message.lpBuffers = &receiveState.m_wsabuf;
+    receiveState.m_message.dwBufferCount = 1;
+    receiveState.m_message.Control.buf = receiveState.m_controlBuffer.data();
+    receiveState.m_message.Control.len = static_cast<ULONG>(receiveState.m_controlBuffer.size());
 
-    auto callback = [this, &receiveState, clientCallback = std::move(clientCallback)](OVERLAPPED* ov) noexcept {
+    auto callback = [this, &receiveState](OVERLAPPED* ov) noexcept {
         try
         {
-            const auto receiveTimestamp = SnapQpcInMicroSec();
+            const auto receiveTimestamp = SnapMonotonicNanoSec();
+            const auto lastPostedReceive = m_postedReceives.fetch_sub(1) == 1;
 
             auto lock = m_lock.lock();
+            if (lastPostedReceive)
+            {
+                ++m_receiveStarvations;
+            }
 
             if (!m_socket.is_valid())
             {
@@ -245,34 +585,56 @@ void MeasuredSocket::PrepareToReceiveDatagram(ReceiveState& receiveState, std::f
                 FAIL_FAST_LAST_ERROR_MSG("A receive operation failed");
             }
 
-            FAIL_FAST_IF_MSG(!ValidateBufferLength(bytesTransferred), "Received an invalid message");
-
-            const auto& header = ParseDatagramHeader(receiveState.m_buffer.data());
-            Log<LogLevel::All>("Received sequence number %lld on socket %zu\n", header.m_sequenceNumber, m_socket.get());
-
-            ReceiveResult result = {
-                .m_sequenceNumber{header.m_sequenceNumber},
-                .m_sendTimestamp{header.m_sendTimestamp},
-                .m_receiveTimestamp{receiveTimestamp},
-                .m_echoTimestamp{header.m_echoTimestamp}};
-            clientCallback(result);
-
-            PrepareToReceiveDatagram(receiveState, std::move(clientCallback));
+            // Split the datagrams coalesced by receive offload: they all share the same receive timestamp.
+            // The server may only echo the header of the datagrams (see EchoMode): any echo holding the header is valid.
+            const std::span receivedBuffer{receiveState.m_buffer.data(), bytesTransferred};
+            ForEachCoalescedDatagram(
+                receivedBuffer, GetCoalescedDatagramSize(receiveState.m_message), [&](std::span<char> datagram) {
+                    FAIL_FAST_IF_MSG(!ValidateBufferLength(datagram.size()), "Received an invalid message");
+
+                    const auto& header = ParseDatagramHeader(datagram.data());
+                    Log<LogLevel::All>("Received sequence number %lld on socket %zu\n", header.m_sequenceNumber, m_socket.get());
+
+                    // Echoes of the pings retried during the connectivity check may arrive late: they are not data
+                    if (header.m_sequenceNumber < 0)
+                    {
+                        Log<LogLevel::Debug>("Ignoring a late ping answer on socket %zu\n", m_socket.get());
+                        return;
+                    }
+
+                    m_roundTripTimes->Record(receiveTimestamp - header.m_sendTimestamp);
+                    if (m_pathPredictor)
+                    {
+                        m_pathPredictor->OnReceived(header.m_sequenceNumber / m_sequenceStride, receiveTimestamp - header.m_sendTimestamp);
+                    }
+
+                    ReceiveResult result = {
+                        .m_sequenceNumber{header.m_sequenceNumber},
+                        .m_sendTimestamp{header.m_sendTimestamp},
+                        .m_receiveTimestamp{receiveTimestamp},
+                        .m_echoTimestamp{header.m_echoTimestamp},
+                        .m_echoEcnCodepoint{
+                            HasEcnField(datagram.size()) ? static_cast<int>(header.m_echoEcnCodepoint) : c_unknownEcnCodepoint}};
+                    m_receiveCallback(result);
+                });
+
+            PrepareToReceiveDatagram(receiveState);
         }
         CATCH_FAIL_FAST_MSG("Unhandled exception in send completion callback");
     };
 
     Log<LogLevel::All>("Initiating receive operation on socket %zu\n", m_socket.get());
 
-    DWORD bytesTransferred = 0;
     OVERLAPPED* ov = m_threadpoolIo->new_request(callback);
-    auto error = WSARecv(m_socket.get(), &wsabuf, 1, &bytesTransferred, &flags, ov, nullptr);
+    m_postedReceives += 1;
+    auto error = m_wsaRecvMsg(m_socket.get(), &receiveState.m_message, nullptr, ov, nullptr);
     if (SOCKET_ERROR == error)
     {
         error = WSAGetLastError();
         if (WSA_IO_PENDING != error)
         {
             m_threadpoolIo->cancel_request(ov);
+            m_postedReceives -= 1;
             FAIL_FAST_WIN32_MSG(error, "Failed to initiate a receive operation");
         }
     }
@@ -4,16 +4,26 @@
 #pragma once
 
 #include <Windows.h>
+#include <WinSock2.h>
+#include <mswsock.h>
 
 #include <wil/resource.h>
 
 #include <array>
+#include <atomic>
+#include <deque>
 #include <functional>
 #include <memory>
+#include <optional>
 
+#include "datagram.h"
+#include "latency_histogram.h"
 #include "latencyStatistics.h"
+#include "path_predictor.h"
 #include "sockaddr.h"
+#include "socket_utils.h"
 #include "threadpool_io.h"
+#include "traffic_class.h"
 
 namespace multipath {
 
@@ -21,7 +31,29 @@ class MeasuredSocket
 {
 public:
     // Size of the buffer used to send or receive
-    static constexpr size_t c_bufferSize = 1024; // 1KB
+    static constexpr size_t c_bufferSize = c_datagramMaxSize;
+
+    // Number of pre-formatted datagrams available for sends in flight
+    static constexpr size_t c_sendRingCapacity = 512;
+
+    // Maximum number of datagrams sent in a single operation when segmentation offload is available
+    static constexpr size_t c_maxSendBatchSize = 32;
+
+    // Size of the receive buffers when receive offload may coalesce datagrams
+    static constexpr size_t c_maxCoalescedReceiveSize = 65535;
+
+    // Initial size of the socket send and receive buffers, and the largest size the autotuner may set
+    static constexpr int c_defaultSocketBufferSize = 1048576;  // 1MB
+    static constexpr int c_maxSocketBufferSize = 64 * 1048576; // 64MB
+
+    // Largest number of receives the autotuner may keep posted
+    static constexpr size_t c_maxReceiveDepth = 64;
+
+    // Connectivity checks retry quickly then back off exponentially, until the overall timeout
+    static constexpr DWORD c_initialPingTimeout = 100;    // 100 msec
+    static constexpr DWORD c_minPingTimeout = 10;         // 10 msec
+    static constexpr DWORD c_maxPingTimeout = 2000;       // 2 sec
+    static constexpr DWORD c_connectivityTimeout = 20000; // 20 sec
 
     enum class AdapterStatus
     {
@@ -33,19 +65,31 @@ public:
     struct SendResult
     {
         long long m_sequenceNumber;
-        long long m_sendTimestamp; // Microsec
+        long long m_sendTimestamp; // Nanosec
     };
 
     struct ReceiveResult
     {
         long long m_sequenceNumber;
-        long long m_sendTimestamp; // Microsec
-        long long m_receiveTimestamp; // Microsec
-        long long m_echoTimestamp; // Microsec
+        long long m_sendTimestamp; // Nanosec
+        long long m_receiveTimestamp; // Nanosec
+        long long m_echoTimestamp; // Nanosec
+        int m_echoEcnCodepoint;    // The ECN field of the datagram received by the server, or c_unknownEcnCodepoint
+    };
+
+    struct TuningState
+    {
+        int m_socketBufferSize; // Bytes
+        size_t m_receiveDepth;
     };
 
     MeasuredSocket() = default;
 
+    // A socket carrying a small share of the datagrams needs fewer send buffers in flight
+    explicit MeasuredSocket(size_t sendRingCapacity) : m_sendRing{sendRingCapacity}
+    {
+    }
+
     // Not copyable or movable
     MeasuredSocket(const MeasuredSocket&) = delete;
     MeasuredSocket& operator=(const MeasuredSocket&) = delete;
@@ -53,13 +97,76 @@ public:
     MeasuredSocket& operator=(MeasuredSocket&&) = delete;
     ~MeasuredSocket() noexcept;
 
-    void Setup(const ctl::ctSockaddr& targetAddress, int numReceivedBuffers, int interfaceIndex = 0);
+    // Mark the datagrams sent after the next setup with a WMM access category, instead of the default marking
+    void SetTrafficClass(TrafficClass trafficClass) noexcept;
+
+    // Set the ECN field of the datagrams sent after the next setup, Not-ECT by default
+    void SetEcnCodepoint(EcnCodepoint ecnCodepoint) noexcept;
+
+    // The socket sends one sequence number out of stride (one flow out of stride): the predictor only counts the gaps
+    // between the sequence numbers of this socket as lost. Must be called before the setup.
+    void SetSequenceStride(long long stride) noexcept;
+
+    // Record the round-trip times in the histogram of the path socket, and make no prediction: the flows of a path only
+    // need the statistics of the path, and their memory must not grow with the number of flows. The path socket
+    // resets the shared histogram at its setup. Must be called before the setup.
+    void SharePathStatistics(const MeasuredSocket& pathSocket) noexcept;
+
+    // udpOffload enables UDP receive offload (coalescing). The sends of a batch use UDP segmentation offload whenever the
+    // OS supports it, as it does not change the measures.
+    void Setup(const ctl::ctSockaddr& targetAddress, int numReceivedBuffers, bool udpOffload, int interfaceIndex = 0);
     void Cancel() noexcept;
 
+    // Ping the echo server until it answers. The first retry happens after twice the round-trip time measured by the
+    // previous check on this socket, or after c_initialPingTimeout, and the wait doubles on each retry.
     void CheckConnectivity();
     void PrepareToReceive(std::function<void(ReceiveResult&)> clientCallback) noexcept;
 
-    void SendDatagram(long long sequenceNumber, std::function<void(const SendResult&)> clientCallback) noexcept;
+    // Send count datagrams with consecutive sequence numbers, starting at firstSequenceNumber.
+    // The client callback is invoked once per datagram when its send completes. The datagrams sent in a single
+    // operation (see c_maxSendBatchSize) share the timestamp of that send.
+    // Returns the number of datagrams actually sent: a datagram is dropped when all the send buffers are in flight.
+    long long SendDatagrams(long long firstSequenceNumber, long long count, std::function<void(const SendResult&)> clientCallback) noexcept;
+
+    // The datagrams dropped by SendDatagrams since the socket was created, because all the send buffers were in flight
+    [[nodiscard]] long long GetSendRingDrops() noexcept;
+
+    // Percentile (0 to 100) of the round-trip times measured on this socket since its setup (on the path with
+    // SharePathStatistics), 0 if none
+    [[nodiscard]] long long GetRoundTripTimePercentile(double percentile) noexcept;
+
+    // Expected round-trip time, loss and confidence for the next datagram, updated on each received datagram
+    void SetPredictorModel(PredictorModel model) noexcept;
+    [[nodiscard]] PathPrediction PredictPath() noexcept;
+
+    // Percentile (0 to 100) of the absolute error of the round-trip time predictions since the socket was created, 0
+    // when sharing the path statistics
+    [[nodiscard]] long long GetPredictionErrorPercentile(double percentile) noexcept;
+
+    // Grow the socket buffers and the number of posted receives to sustain the given bitrate (in bit/s).
+    // The socket buffers are sized to hold twice the data sent during the 99.9th percentile of the round-trip times
+    // observed so far. The posted receives are doubled when all of them completed before any was re-posted since the
+    // previous call, or when the host dropped received datagrams. Nothing is ever shrunk.
+    void Autotune(unsigned long bitRate, bool hostReceiveDropsIncreased) noexcept;
+    [[nodiscard]] TuningState GetTuningState() noexcept;
+
+    // The interface given to the last setup, 0 for the default interface
+    [[nodiscard]] int GetInterfaceIndex() const noexcept
+    {
+        return m_interfaceIndex;
+    }
+
+    // The round-trip time of the ping that confirmed the connectivity in the last check, 0 before any check
+    [[nodiscard]] long long GetHandshakeRoundTripTime() const noexcept
+    {
+        return m_handshakeRoundTripTime.load();
+    }
+
+    // The local port picked at the last setup, the source port of the flow, 0 before any setup
+    [[nodiscard]] unsigned short GetLocalPort() const noexcept
+    {
+        return m_localPort;
+    }
 
     std::atomic<AdapterStatus> m_adapterStatus{AdapterStatus::Disabled};
     long long m_corruptDatagrams = 0;
@@ -67,31 +174,69 @@ public:
 private:
     struct ReceiveState
     {
-        std::array<char, c_bufferSize> m_buffer{};
-        long long m_receiveTimestamp{};
+        std::vector<char> m_buffer;
+        alignas(WSACMSGHDR) std::array<char, c_controlBufferSize> m_controlBuffer{};
+        WSABUF m_wsabuf{};
+        WSAMSG m_message{};
     };
 
-    void PrepareToReceiveDatagram(ReceiveState& receiveState, std::function<void(ReceiveResult&)> clientCallback) noexcept;
-    void PrepareToReceivePing(wil::shared_event pingReceived);
+    struct SendBatch
+    {
+        std::array<DatagramSendBuffer*, c_maxSendBatchSize> m_buffers{};
+        size_t m_count = 0;
+    };
+
+    void SendBatchUnderLock(const SendBatch& batch, const std::function<void(const SendResult&)>& clientCallback) noexcept;
+    void PrepareToReceiveDatagram(ReceiveState& receiveState) noexcept;
+    // pingReceived is set when a ping answer is received, receiveCompleted when the receive completes in any way
+    // (answered, canceled or socket closed): the first receive buffer can only be reused after it
+    OVERLAPPED* PrepareToReceivePing(wil::shared_event pingReceived, wil::shared_event receiveCompleted);
     void PingEchoServer();
 
-    // the contexts used for each posted receive
-    std::vector<ReceiveState> m_receiveStates;
+    // the contexts used for each posted receive. A deque, so that growing it keeps the posted contexts in place
+    std::deque<ReceiveState> m_receiveStates;
+    std::function<void(ReceiveResult&)> m_receiveCallback;
+    size_t m_receiveBufferSize = c_bufferSize;
+
+    // Receives currently posted, and the number of times a completion found none left (the application was too slow
+    // to re-post them)
+    std::atomic<long long> m_postedReceives{0};
+    long long m_receiveStarvations = 0;
+    long long m_tunedReceiveStarvations = 0;
+
+    // Datagrams that were never sent: they are not network losses
+    long long m_sendRingDrops = 0;
+
+    int m_socketBufferSize = c_defaultSocketBufferSize;
+    int m_interfaceIndex = 0;
+    unsigned short m_localPort = 0;
+    // Shared with the flow sockets of the path, see SharePathStatistics
+    std::shared_ptr<LatencyHistogram> m_roundTripTimes{std::make_shared<LatencyHistogram>()};
+    bool m_sharesPathStatistics = false;
+    std::optional<PathPredictor> m_pathPredictor{std::in_place};
+    long long m_sequenceStride = 1;
+
+    // Round-trip time of the ping that confirmed the connectivity, kept across setups. Written by the ping callback
+    // under the lock, read without it.
+    std::atomic<long long> m_handshakeRoundTripTime{0}; // Nanosec
 
     wil::critical_section m_lock{500};
+    std::optional<TrafficClass> m_trafficClass;
+    unique_qos_handle m_qosHandle;
     wil::unique_socket m_socket;
     std::unique_ptr<ctl::ctThreadIocp> m_threadpoolIo;
+    LPFN_WSARECVMSG m_wsaRecvMsg = nullptr;
+
+    // The datagrams to send, kept alive until their send completes
+    DatagramSendRing m_sendRing{c_sendRingCapacity};
+
+    // Whether the network stack splits a send into datagrams of c_bufferSize bytes (UDP segmentation offload)
+    bool m_sendOffloadEnabled = false;
 
-    // All interfaces are sending the same data, stored in a shared buffer
-    static constexpr const std::array<char, c_bufferSize> s_sharedSendBuffer = []() {
-        // initialize the send buffer
-        std::array<char, c_bufferSize> sharedSendBuffer{};
-        for (size_t i = 0; i < sharedSendBuffer.size(); ++i)
-        {
-            sharedSendBuffer[i] = static_cast<char>(i);
-        }
-        return sharedSendBuffer;
-    }();
+    // The control message setting the ECN field of the datagrams, formatted once at setup and only read by the sends
+    EcnCodepoint m_ecnCodepoint = EcnCodepoint::NotEct;
+    alignas(WSACMSGHDR) std::array<char, c_controlBufferSize> m_sendControlBuffer{};
+    ULONG m_sendControlLength = 0;
 };
 
 } // namespace multipath
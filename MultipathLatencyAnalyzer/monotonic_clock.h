@@ -0,0 +1,149 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#if defined(_WIN32)
+#include "time_utils.h"
+#else
+#include <time.h>
+#endif
+
+#if defined(_M_IX86) || defined(_M_X64)
+#include <intrin.h>
+#define MULTIPATH_TSC_CLOCK_SUPPORTED 1
+#elif defined(__i386__) || defined(__x86_64__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#define MULTIPATH_TSC_CLOCK_SUPPORTED 1
+#endif
+
+#include <chrono>
+#include <thread>
+
+namespace multipath {
+
+constexpr long long c_nanoSecInSecond = 1'000'000'000LL;
+
+// Convert a tick count at the given frequency (in Hz) to nanoseconds.
+// The whole seconds and the remaining ticks are scaled separately: the only multiplication on the remainder is
+// (remainder * 1e9), with remainder < frequency, which cannot overflow for any frequency below ~9.2 GHz.
+// A single (ticks * 1e9 / frequency) would overflow once ticks exceed ~9.2e9: after about 15 minutes of uptime on a
+// 10 MHz QPC, and after a few seconds of TSC ticks at GHz rates.
+constexpr long long ConvertTicksToNanoSec(long long ticks, long long frequency) noexcept
+{
+    const long long seconds = ticks / frequency;
+    const long long remainder = ticks % frequency;
+    return seconds * c_nanoSecInSecond + remainder * c_nanoSecInSecond / frequency;
+}
+
+static_assert(ConvertTicksToNanoSec(10'000'000, 10'000'000) == c_nanoSecInSecond);
+// ~29 years of uptime on a 10 MHz QPC: the naive conversion would have overflowed long before
+static_assert(ConvertTicksToNanoSec(9'200'000'000'000'000, 10'000'000) == 920'000'000'000'000'000);
+
+// The time source used when the TSC fast path is not enabled, in nanoseconds
+inline long long SnapBaseClockNanoSec() noexcept
+{
+#if defined(_WIN32)
+    // snap the frequency on first call; C++11 guarantees this is thread-safe
+    static const long long c_qpf = []() {
+        LARGE_INTEGER qpf;
+        QueryPerformanceFrequency(&qpf);
+        return qpf.QuadPart;
+    }();
+
+    return ConvertTicksToNanoSec(SnapQpc(), c_qpf);
+#else
+    // CLOCK_MONOTONIC_RAW is not subject to NTP frequency adjustments, as QPC
+    timespec now{};
+    clock_gettime(CLOCK_MONOTONIC_RAW, &now);
+    return now.tv_sec * c_nanoSecInSecond + now.tv_nsec;
+#endif
+}
+
+// Parameters of the TSC fast path, set once by EnableTscClock before any measurement
+struct TscClockCalibration
+{
+    long long m_frequency = 0; // Hz, 0 when the TSC fast path is disabled
+    long long m_baseTicks = 0;
+    long long m_baseNanoSec = 0;
+};
+
+inline TscClockCalibration g_tscClockCalibration{};
+
+#if defined(MULTIPATH_TSC_CLOCK_SUPPORTED)
+inline long long SnapTsc() noexcept
+{
+    return static_cast<long long>(__rdtsc());
+}
+
+// The TSC can only be used as a clock if its rate does not change with the processor's power state
+inline bool IsTscInvariant() noexcept
+{
+    unsigned int registers[4]{};
+#if defined(_MSC_VER)
+    __cpuid(reinterpret_cast<int*>(registers), 0x80000000);
+    if (registers[0] < 0x80000007)
+    {
+        return false;
+    }
+    __cpuid(reinterpret_cast<int*>(registers), 0x80000007);
+#else
+    if (!__get_cpuid(0x80000007, &registers[0], &registers[1], &registers[2], &registers[3]))
+    {
+        return false;
+    }
+#endif
+    // EDX bit 8: invariant TSC
+    return (registers[3] & (1u << 8)) != 0;
+}
+#endif
+
+// Switch the monotonic clock to the TSC, calibrated against the base clock.
+// Must be called before any other thread reads the clock. Returns false if the processor has no invariant TSC,
+// in which case the base clock keeps being used.
+inline bool EnableTscClock() noexcept
+{
+#if defined(MULTIPATH_TSC_CLOCK_SUPPORTED)
+    if (!IsTscInvariant())
+    {
+        return false;
+    }
+
+    constexpr auto c_calibrationDuration = std::chrono::milliseconds(100);
+
+    const auto startNanoSec = SnapBaseClockNanoSec();
+    const auto startTicks = SnapTsc();
+    std::this_thread::sleep_for(c_calibrationDuration);
+    const auto endNanoSec = SnapBaseClockNanoSec();
+    const auto endTicks = SnapTsc();
+
+    // (endTicks - startTicks) is ~1e9 for a 10 GHz TSC: the product stays well within 64 bits
+    const auto frequency = (endTicks - startTicks) * c_nanoSecInSecond / (endNanoSec - startNanoSec);
+    if (frequency <= 0)
+    {
+        return false;
+    }
+
+    // The TSC clock continues the base clock from the end of the calibration
+    g_tscClockCalibration = {.m_frequency{frequency}, .m_baseTicks{endTicks}, .m_baseNanoSec{endNanoSec}};
+    return true;
+#else
+    return false;
+#endif
+}
+
+// Monotonic timestamp in nanoseconds, without a fixed origin
+inline long long SnapMonotonicNanoSec() noexcept
+{
+#if defined(MULTIPATH_TSC_CLOCK_SUPPORTED)
+    if (g_tscClockCalibration.m_frequency != 0)
+    {
+        return g_tscClockCalibration.m_baseNanoSec +
+               ConvertTicksToNanoSec(SnapTsc() - g_tscClockCalibration.m_baseTicks, g_tscClockCalibration.m_frequency);
+    }
+#endif
+    return SnapBaseClockNanoSec();
+}
+
+} // namespace multipath
@@ -0,0 +1,165 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include "latency_histogram.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+namespace multipath {
+
+enum class PredictorModel
+{
+    Ewma,  // smoothed latency and mean deviation, as TCP's retransmission timer (RFC 6298)
+    Kalman // one-dimensional Kalman filter, the latency being a random walk
+};
+
+// What a path is expected to do for the next datagram
+struct PathPrediction
+{
+    long long m_latency = 0;   // Nanosec
+    long long m_deviation = 0; // Nanosec, the expected error of m_latency
+    double m_lossProbability = 0.;
+
+    // From 0 to 1: low until enough samples were seen, and when the latency varies a lot compared to its value
+    double m_confidence = 0.;
+};
+
+// Online latency and loss estimator for one path, updated in O(1) on each received datagram.
+// Not thread-safe: the owner serializes the updates and the predictions.
+class PathPredictor
+{
+public:
+    explicit PathPredictor(PredictorModel model = PredictorModel::Ewma) noexcept : m_model(model)
+    {
+    }
+
+    ~PathPredictor() noexcept = default;
+
+    PathPredictor(const PathPredictor&) = delete;
+    PathPredictor& operator=(const PathPredictor&) = delete;
+    PathPredictor(PathPredictor&&) = delete;
+    PathPredictor& operator=(PathPredictor&&) = delete;
+
+    void SetModel(PredictorModel model) noexcept
+    {
+        m_model = model;
+    }
+
+    // Forget the path state, keeping the model and the prediction errors
+    void Reset() noexcept
+    {
+        m_samples = 0;
+        m_latency = 0.;
+        m_deviation = 0.;
+        m_variance = 0.;
+        m_errorVariance = 0.;
+        m_lossProbability = 0.;
+        m_highestSequenceNumber = -1;
+    }
+
+    // Update the estimate with a received datagram. The sequence numbers skipped since the highest one received are
+    // counted as lost: a reordered datagram is briefly counted as lost.
+    void OnReceived(long long sequenceNumber, long long latency) noexcept
+    {
+        // How far off the prediction was
+        if (m_samples > 0)
+        {
+            m_predictionErrors.Record(std::llabs(latency - static_cast<long long>(m_latency)));
+        }
+
+        UpdateLoss(sequenceNumber);
+
+        const auto sample = static_cast<double>(latency);
+        if (m_samples == 0)
+        {
+            m_latency = sample;
+            m_deviation = sample / 2;
+            m_variance = m_deviation * m_deviation;
+            m_errorVariance = m_variance;
+        }
+        else if (m_model == PredictorModel::Ewma)
+        {
+            m_deviation += (std::abs(sample - m_latency) - m_deviation) * c_deviationGain;
+            m_latency += (sample - m_latency) * c_latencyGain;
+        }
+        else
+        {
+            // The measurement noise is the variance of the samples around the estimate
+            const auto innovation = sample - m_latency;
+            m_variance += (innovation * innovation - m_variance) * c_deviationGain;
+            const auto measurementNoise = (std::max)(m_variance, c_minVariance);
+
+            const auto predictedErrorVariance = m_errorVariance + measurementNoise * c_processNoiseRatio;
+            const auto gain = predictedErrorVariance / (predictedErrorVariance + measurementNoise);
+            m_latency += gain * innovation;
+            m_errorVariance = (1 - gain) * predictedErrorVariance;
+            m_deviation = std::sqrt(m_errorVariance + measurementNoise);
+        }
+
+        m_samples += 1;
+    }
+
+    [[nodiscard]] PathPrediction Predict() const noexcept
+    {
+        PathPrediction prediction;
+        prediction.m_latency = static_cast<long long>(m_latency);
+        prediction.m_deviation = static_cast<long long>(m_deviation);
+        prediction.m_lossProbability = m_lossProbability;
+        if (m_samples > 0)
+        {
+            const auto sampleConfidence = static_cast<double>(m_samples) / (m_samples + c_confidenceSamples);
+            const auto stabilityConfidence = m_latency / (m_latency + m_deviation);
+            prediction.m_confidence = sampleConfidence * stabilityConfidence;
+        }
+        return prediction;
+    }
+
+    // Absolute difference between the predicted latency and the latency of the next datagram, in nanoseconds
+    [[nodiscard]] const LatencyHistogram& GetPredictionErrors() const noexcept
+    {
+        return m_predictionErrors;
+    }
+
+private:
+    static constexpr double c_latencyGain = 1. / 8;
+    static constexpr double c_deviationGain = 1. / 4;
+    static constexpr double c_lossGain = 1. / 32;
+
+    // Kalman filter: how much the latency itself is expected to move between two datagrams, relative to the
+    // measurement noise, and a floor of the measurement noise (1 microsecond squared)
+    static constexpr double c_processNoiseRatio = 1. / 16;
+    static constexpr double c_minVariance = 1'000'000.;
+
+    // Number of samples after which the confidence reaches one half, for a stable latency
+    static constexpr long long c_confidenceSamples = 16;
+
+    void UpdateLoss(long long sequenceNumber) noexcept
+    {
+        if (m_highestSequenceNumber >= 0 && sequenceNumber > m_highestSequenceNumber + 1)
+        {
+            // One update per skipped sequence number, in closed form
+            const auto lostDatagrams = static_cast<double>(sequenceNumber - m_highestSequenceNumber - 1);
+            m_lossProbability = 1 - (1 - m_lossProbability) * std::pow(1 - c_lossGain, lostDatagrams);
+        }
+        m_lossProbability *= 1 - c_lossGain;
+        m_highestSequenceNumber = (std::max)(m_highestSequenceNumber, sequenceNumber);
+    }
+
+    PredictorModel m_model;
+
+    long long m_samples = 0;
+    double m_latency = 0.;       // Nanosec
+    double m_deviation = 0.;     // Nanosec
+    double m_variance = 0.;      // Nanosec squared, Kalman measurement noise
+    double m_errorVariance = 0.; // Nanosec squared, Kalman estimate error
+    double m_lossProbability = 0.;
+    long long m_highestSequenceNumber = -1;
+
+    LatencyHistogram m_predictionErrors;
+};
+
+} // namespace multipath
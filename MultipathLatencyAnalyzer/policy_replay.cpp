@@ -0,0 +1,385 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#include "policy_replay.h"
+
+#include <algorithm>
+#include <execution>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <queue>
+
+namespace multipath {
+namespace {
+
+    constexpr size_t c_primary = 0;
+    constexpr size_t c_secondary = 1;
+
+    constexpr bool Uses(PathChoice choice, PathChoice path) noexcept
+    {
+        return (static_cast<unsigned char>(choice) & static_cast<unsigned char>(path)) != 0;
+    }
+
+    // Exponentially weighted moving average of the latency of an interface, with the same gain as TCP's smoothed RTT.
+    // A loss counts as a datagram received after c_lossFeedbackDelay.
+    class LatencyAverage
+    {
+    public:
+        void Update(long long latency, bool lost) noexcept
+        {
+            const auto sample = lost ? ReplayPolicy::c_lossFeedbackDelay : latency;
+            m_value = m_initialized ? m_value + (sample - m_value) / 8 : sample;
+            m_initialized = true;
+        }
+
+        [[nodiscard]] long long Get() const noexcept
+        {
+            return m_value;
+        }
+
+    private:
+        long long m_value = 0;
+        bool m_initialized = false;
+    };
+
+    class SinglePathPolicy final : public ReplayPolicy
+    {
+    public:
+        explicit SinglePathPolicy(PathChoice path) noexcept : m_path(path)
+        {
+        }
+
+        [[nodiscard]] std::string GetName() const override
+        {
+            return m_path == PathChoice::Primary ? "Primary only" : "Secondary only";
+        }
+
+        PathChoice Choose(size_t) override
+        {
+            return m_path;
+        }
+
+        void OnFeedback(PathChoice, long long, bool) override
+        {
+        }
+
+    private:
+        PathChoice m_path;
+    };
+
+    class DuplicatePolicy final : public ReplayPolicy
+    {
+    public:
+        [[nodiscard]] std::string GetName() const override
+        {
+            return "Always duplicate";
+        }
+
+        PathChoice Choose(size_t) override
+        {
+            return PathChoice::Both;
+        }
+
+        void OnFeedback(PathChoice, long long, bool) override
+        {
+        }
+    };
+
+    class AlternatePolicy final : public ReplayPolicy
+    {
+    public:
+        [[nodiscard]] std::string GetName() const override
+        {
+            return "Alternate";
+        }
+
+        PathChoice Choose(size_t sample) override
+        {
+            return sample % 2 == 0 ? PathChoice::Primary : PathChoice::Secondary;
+        }
+
+        void OnFeedback(PathChoice, long long, bool) override
+        {
+        }
+    };
+
+    // Send on the interface with the lowest latency average. The other interface is probed periodically, by
+    // duplicating a datagram, to keep its average up to date.
+    class BestPredictedPathPolicy final : public ReplayPolicy
+    {
+    public:
+        static constexpr size_t c_probeInterval = 100;
+
+        [[nodiscard]] std::string GetName() const override
+        {
+            return "Best predicted path";
+        }
+
+        PathChoice Choose(size_t sample) override
+        {
+            if (sample % c_probeInterval == 0)
+            {
+                return PathChoice::Both;
+            }
+
+            return m_averages[c_secondary].Get() < m_averages[c_primary].Get() ? PathChoice::Secondary : PathChoice::Primary;
+        }
+
+        void OnFeedback(PathChoice path, long long latency, bool lost) override
+        {
+            m_averages[path == PathChoice::Primary ? c_primary : c_secondary].Update(latency, lost);
+        }
+
+    private:
+        std::array<LatencyAverage, 2> m_averages{};
+    };
+
+    // Always send on the primary interface, and duplicate on the secondary interface while the primary latency
+    // average is above a threshold
+    class DuplicateAboveThresholdPolicy final : public ReplayPolicy
+    {
+    public:
+        explicit DuplicateAboveThresholdPolicy(long long threshold) noexcept : m_threshold(threshold)
+        {
+        }
+
+        [[nodiscard]] std::string GetName() const override
+        {
+            return "Duplicate when primary > " + std::to_string(m_threshold / 1'000'000) + " ms";
+        }
+
+        PathChoice Choose(size_t) override
+        {
+            return m_primaryAverage.Get() > m_threshold ? PathChoice::Both : PathChoice::Primary;
+        }
+
+        void OnFeedback(PathChoice path, long long latency, bool lost) override
+        {
+            if (path == PathChoice::Primary)
+            {
+                m_primaryAverage.Update(latency, lost);
+            }
+        }
+
+    private:
+        long long m_threshold;
+        LatencyAverage m_primaryAverage{};
+    };
+
+    // Always send on the primary interface, and duplicate every k-th datagram on the secondary interface
+    class DuplicateEveryKthPolicy final : public ReplayPolicy
+    {
+    public:
+        explicit DuplicateEveryKthPolicy(size_t k) noexcept : m_k(k)
+        {
+        }
+
+        [[nodiscard]] std::string GetName() const override
+        {
+            return "Duplicate 1 in " + std::to_string(m_k) + " datagrams";
+        }
+
+        PathChoice Choose(size_t sample) override
+        {
+            return sample % m_k == 0 ? PathChoice::Both : PathChoice::Primary;
+        }
+
+        void OnFeedback(PathChoice, long long, bool) override
+        {
+        }
+
+    private:
+        size_t m_k;
+    };
+
+    // Run the policy over the trace, feeding it back the outcome of its choices in the order it would have learnt them
+    std::vector<PathChoice> RunPolicy(const ReplayTrace& trace, ReplayPolicy& policy)
+    {
+        struct Feedback
+        {
+            long long m_time;
+            long long m_latency;
+            PathChoice m_path;
+            bool m_lost;
+        };
+        auto later = [](const Feedback& a, const Feedback& b) { return a.m_time > b.m_time; };
+        std::priority_queue<Feedback, std::vector<Feedback>, decltype(later)> pendingFeedback{later};
+
+        const auto samples = trace.m_sendTimestamps.size();
+        std::vector<PathChoice> choices(samples);
+        for (size_t i = 0; i < samples; ++i)
+        {
+            const auto now = trace.m_sendTimestamps[i];
+            while (!pendingFeedback.empty() && pendingFeedback.top().m_time <= now)
+            {
+                const auto& feedback = pendingFeedback.top();
+                policy.OnFeedback(feedback.m_path, feedback.m_latency, feedback.m_lost);
+                pendingFeedback.pop();
+            }
+
+            choices[i] = policy.Choose(i);
+            for (const auto path : {PathChoice::Primary, PathChoice::Secondary})
+            {
+                if (!Uses(choices[i], path))
+                {
+                    continue;
+                }
+
+                const auto latency = trace.m_latencies[path == PathChoice::Primary ? c_primary : c_secondary][i];
+                if (latency >= 0)
+                {
+                    pendingFeedback.push({now + latency, latency, path, false});
+                }
+                else
+                {
+                    pendingFeedback.push({now + ReplayPolicy::c_lossFeedbackDelay, 0, path, true});
+                }
+            }
+        }
+
+        return choices;
+    }
+
+    ReplayResult EvaluateChoices(const ReplayTrace& trace, const std::vector<PathChoice>& choices)
+    {
+        const auto samples = choices.size();
+        const auto* primaryLatencies = trace.m_latencies[c_primary].data();
+        const auto* secondaryLatencies = trace.m_latencies[c_secondary].data();
+
+        // Branch-free loop over the samples, so that the compiler can vectorize it.
+        // A loss is -1: compared as unsigned it is larger than any latency, so the minimum is the first copy received,
+        // or -1 if none was.
+        std::vector<long long> latencies(samples);
+        long long sentDatagrams = 0;
+        for (size_t i = 0; i < samples; ++i)
+        {
+            const auto choice = static_cast<unsigned char>(choices[i]);
+            const auto usePrimary = choice & static_cast<unsigned char>(PathChoice::Primary);
+            const auto useSecondary = (choice & static_cast<unsigned char>(PathChoice::Secondary)) >> 1;
+            const auto primary = static_cast<unsigned long long>(usePrimary ? primaryLatencies[i] : -1LL);
+            const auto secondary = static_cast<unsigned long long>(useSecondary ? secondaryLatencies[i] : -1LL);
+            latencies[i] = static_cast<long long>((std::min)(primary, secondary));
+            sentDatagrams += usePrimary + useSecondary;
+        }
+
+        // The losses sort last
+        const auto received = std::partition(latencies.begin(), latencies.end(), [](long long l) { return l >= 0; });
+        latencies.erase(received, latencies.end());
+        std::sort(latencies.begin(), latencies.end());
+
+        auto percentile = [&](double p) {
+            if (latencies.empty())
+            {
+                return 0LL;
+            }
+            return latencies[(std::min)(latencies.size() - 1, static_cast<size_t>(p / 100. * latencies.size()))];
+        };
+
+        ReplayResult result;
+        result.m_samples = static_cast<long long>(samples);
+        result.m_sentDatagrams = sentDatagrams;
+        result.m_sentBytes = sentDatagrams * static_cast<long long>(trace.m_datagramSize);
+        result.m_lostDatagrams = static_cast<long long>(samples - latencies.size());
+        if (!latencies.empty())
+        {
+            result.m_averageLatency =
+                std::accumulate(latencies.begin(), latencies.end(), 0LL) / static_cast<long long>(latencies.size());
+        }
+        result.m_medianLatency = percentile(50);
+        result.m_latency99 = percentile(99);
+        result.m_latency999 = percentile(99.9);
+        return result;
+    }
+
+} // namespace
+
+ReplayTrace BuildReplayTrace(const LatencyData& data)
+{
+    const auto& primary = data.m_primary.m_latencies;
+    const auto& secondary = data.m_secondary.m_latencies;
+
+    ReplayTrace trace;
+    trace.m_datagramSize = data.m_datagramSize;
+    for (size_t i = 0; i < (std::max)(primary.size(), secondary.size()); ++i)
+    {
+        const auto primarySent = i < primary.size() && primary[i].m_sendTimestamp >= 0;
+        const auto secondarySent = i < secondary.size() && secondary[i].m_sendTimestamp >= 0;
+        if (!primarySent || !secondarySent)
+        {
+            trace.m_ignoredDatagrams += primarySent || secondarySent ? 1 : 0;
+            continue;
+        }
+
+        auto latency = [](const PathLatencyMeasure& measure) {
+            return measure.m_receiveTimestamp >= 0 ? measure.m_receiveTimestamp - measure.m_sendTimestamp : -1LL;
+        };
+
+        trace.m_sendTimestamps.push_back((std::min)(primary[i].m_sendTimestamp, secondary[i].m_sendTimestamp));
+        trace.m_latencies[c_primary].push_back(latency(primary[i]));
+        trace.m_latencies[c_secondary].push_back(latency(secondary[i]));
+    }
+
+    return trace;
+}
+
+std::vector<std::unique_ptr<ReplayPolicy>> CreateDefaultReplayPolicies()
+{
+    std::vector<std::unique_ptr<ReplayPolicy>> policies;
+    policies.push_back(std::make_unique<SinglePathPolicy>(PathChoice::Primary));
+    policies.push_back(std::make_unique<SinglePathPolicy>(PathChoice::Secondary));
+    policies.push_back(std::make_unique<DuplicatePolicy>());
+    policies.push_back(std::make_unique<AlternatePolicy>());
+    policies.push_back(std::make_unique<BestPredictedPathPolicy>());
+    policies.push_back(std::make_unique<DuplicateAboveThresholdPolicy>(10'000'000));
+    policies.push_back(std::make_unique<DuplicateAboveThresholdPolicy>(20'000'000));
+    policies.push_back(std::make_unique<DuplicateAboveThresholdPolicy>(50'000'000));
+    policies.push_back(std::make_unique<DuplicateEveryKthPolicy>(2));
+    policies.push_back(std::make_unique<DuplicateEveryKthPolicy>(4));
+    return policies;
+}
+
+std::vector<ReplayResult> ReplayPolicies(const ReplayTrace& trace, const std::vector<std::unique_ptr<ReplayPolicy>>& policies)
+{
+    // Each policy only touches its own state and result
+    std::vector<ReplayResult> results(policies.size());
+    std::vector<size_t> indexes(policies.size());
+    std::iota(indexes.begin(), indexes.end(), size_t{0});
+    std::for_each(std::execution::par, indexes.begin(), indexes.end(), [&](size_t i) {
+        results[i] = EvaluateChoices(trace, RunPolicy(trace, *policies[i]));
+        results[i].m_policyName = policies[i]->GetName();
+    });
+
+    return results;
+}
+
+void PrintReplayResults(const ReplayTrace& trace, const std::vector<ReplayResult>& results)
+{
+    auto percent = [](auto a, auto b) { return b > 0 ? a * 100. / b : 0.; };
+
+    std::cout << std::setprecision(2) << std::fixed;
+
+    std::cout << '\n';
+    std::cout << "-----------------------------------------------------------------------\n";
+    std::cout << "                            POLICY REPLAY                              \n";
+    std::cout << "-----------------------------------------------------------------------\n";
+    std::cout << '\n';
+    std::cout << trace.m_sendTimestamps.size() << " datagrams sent on both interfaces were replayed ("
+              << trace.m_ignoredDatagrams << " datagrams sent on a single interface were ignored).\n";
+
+    for (const auto& result : results)
+    {
+        std::cout << '\n';
+        std::cout << "--- " << result.m_policyName << " ---\n";
+        std::cout << "Sent datagrams: " << result.m_sentDatagrams << " (" << result.m_sentBytes / 1024 << " kB, "
+                  << percent(result.m_sentDatagrams, result.m_samples) << "% of the datagrams)\n";
+        std::cout << "Lost datagrams: " << result.m_lostDatagrams << " ("
+                  << percent(result.m_lostDatagrams, result.m_samples) << "%)\n";
+        std::cout << "Average / median / 99th / 99.9th percentile latency: " << ConvertNanosToMillis(result.m_averageLatency)
+                  << " ms / " << ConvertNanosToMillis(result.m_medianLatency) << " ms / "
+                  << ConvertNanosToMillis(result.m_latency99) << " ms / " << ConvertNanosToMillis(result.m_latency999)
+                  << " ms\n";
+    }
+}
+
+} // namespace multipath
@@ -0,0 +1,88 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include "latencyStatistics.h"
+
+#include <array>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace multipath {
+
+// The interfaces on which a scheduling policy sends a datagram
+enum class PathChoice : unsigned char
+{
+    Primary = 1,
+    Secondary = 2,
+    Both = Primary | Secondary
+};
+
+// A run where datagrams were duplicated on both interfaces, reorganized to be replayed.
+// Sample i is the i-th datagram sent on both interfaces: it tells what each interface would have delivered.
+struct ReplayTrace
+{
+    std::vector<long long> m_sendTimestamps; // Nanosec
+
+    // Latency of each sample on the primary and the secondary interface, -1 if the datagram was lost
+    std::array<std::vector<long long>, 2> m_latencies; // Nanosec
+
+    size_t m_datagramSize = 0;
+
+    // Datagrams sent on a single interface cannot be replayed
+    long long m_ignoredDatagrams = 0;
+};
+
+ReplayTrace BuildReplayTrace(const LatencyData& data);
+
+// A multipath scheduling strategy, replayed over a trace.
+// A policy only learns about the interfaces it chose: the latency of a datagram when its echo would have been
+// received, or its loss c_lossFeedbackDelay after it was sent.
+class ReplayPolicy
+{
+public:
+    static constexpr long long c_lossFeedbackDelay = 1'000'000'000; // 1 sec
+
+    ReplayPolicy() = default;
+    virtual ~ReplayPolicy() = default;
+
+    ReplayPolicy(const ReplayPolicy&) = delete;
+    ReplayPolicy& operator=(const ReplayPolicy&) = delete;
+    ReplayPolicy(ReplayPolicy&&) = delete;
+    ReplayPolicy& operator=(ReplayPolicy&&) = delete;
+
+    [[nodiscard]] virtual std::string GetName() const = 0;
+    virtual PathChoice Choose(size_t sample) = 0;
+    virtual void OnFeedback(PathChoice path, long long latency, bool lost) = 0;
+};
+
+// Primary only, secondary only, always duplicate, alternate, best predicted interface, duplicate when the primary
+// latency average goes above 10, 20 and 50 ms, and duplicate 1 in 2 and 1 in 4 datagrams
+std::vector<std::unique_ptr<ReplayPolicy>> CreateDefaultReplayPolicies();
+
+// What a policy would have achieved over a trace
+struct ReplayResult
+{
+    std::string m_policyName;
+    long long m_samples = 0;
+    long long m_sentDatagrams = 0;
+    long long m_sentBytes = 0;
+
+    // Samples delivered on none of the chosen interfaces
+    long long m_lostDatagrams = 0;
+
+    // Latency of the first copy received, in nanoseconds
+    long long m_averageLatency = 0;
+    long long m_medianLatency = 0;
+    long long m_latency99 = 0;
+    long long m_latency999 = 0;
+};
+
+// Replay the trace through each policy, the policies being replayed in parallel
+std::vector<ReplayResult> ReplayPolicies(const ReplayTrace& trace, const std::vector<std::unique_ptr<ReplayPolicy>>& policies);
+
+void PrintReplayResults(const ReplayTrace& trace, const std::vector<ReplayResult>& results);
+
+} // namespace multipath
@@ -0,0 +1,32 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include "threadpool_timer.h"
+
+#include <string>
+
+namespace multipath {
+
+// The interfaces on which each datagram of a phase is sent
+enum class DuplicationPolicy
+{
+    Both,     // every datagram is sent on both interfaces
+    Primary,  // the primary interface only
+    Secondary // the secondary interface only
+};
+
+// One line of a scenario file: the client streams with these settings for the duration of the phase, then moves to
+// the next phase on the same sockets
+struct ScenarioPhase
+{
+    std::wstring m_name;
+    unsigned long m_bitRate = 0; // bit/s
+    unsigned long m_grouping = 0;
+    unsigned long m_duration = 0; // sec
+    TimerOverrunPolicy m_overrunPolicy = TimerOverrunPolicy::Burst;
+    DuplicationPolicy m_duplication = DuplicationPolicy::Both;
+};
+
+} // namespace multipath
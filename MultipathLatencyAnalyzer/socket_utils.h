@@ -4,8 +4,15 @@
 #pragma once
 
 #include <WinSock2.h>
+#include <WS2tcpip.h>
+#include <mswsock.h>
+#include <iphlpapi.h>
+#include <qos2.h>
+#include <wil/resource.h>
 #include <wil/result.h>
 
+#include <span>
+
 //
 namespace multipath {
 inline SOCKET CreateDatagramSocket(short family = AF_INET)
@@ -20,6 +27,17 @@ inline SOCKET CreateDatagramSocket(short family = AF_INET)
     return socket;
 }
 
+// Let an IPv6 socket also send and receive IPv4 traffic, as IPv4-mapped IPv6 addresses
+inline void SetSocketDualMode(SOCKET socket)
+{
+    const DWORD v6Only = 0;
+    const auto error = setsockopt(socket, IPPROTO_IPV6, IPV6_V6ONLY, reinterpret_cast<const char*>(&v6Only), sizeof(v6Only));
+    if (ERROR_SUCCESS != error)
+    {
+        THROW_WIN32_MSG(WSAGetLastError(), "setsockopt(IPPROTO_IPV6, IPV6_V6ONLY) failed");
+    }
+}
+
 inline void SetSocketOutgoingInterface(SOCKET socket, short family, int outgoingIfIndex)
 {
     if (outgoingIfIndex == 0)
@@ -56,6 +74,132 @@ inline void SetSocketOutgoingInterface(SOCKET socket, short family, int outgoing
     }
 }
 
+// Enable UDP segmentation offload: a single send of N * messageSize bytes is split into N datagrams by the network
+// stack (or the NIC). Returns false if the OS does not support it, in which case each send carries a single datagram.
+inline bool TrySetSocketSendMessageSize(SOCKET socket, DWORD messageSize) noexcept
+{
+    const auto error = setsockopt(socket, IPPROTO_UDP, UDP_SEND_MSG_SIZE, reinterpret_cast<const char*>(&messageSize), sizeof(messageSize));
+    return ERROR_SUCCESS == error;
+}
+
+// Enable UDP receive offload: the network stack (or the NIC) may coalesce consecutive datagrams from the same source
+// into a single receive of up to maxCoalescedSize bytes. The size of the coalesced datagrams is reported in a
+// UDP_COALESCED_INFO control message. Returns false if the OS does not support it.
+inline bool TrySetSocketReceiveMaxCoalescedSize(SOCKET socket, DWORD maxCoalescedSize) noexcept
+{
+    const auto error = setsockopt(
+        socket, IPPROTO_UDP, UDP_RECV_MAX_COALESCED_SIZE, reinterpret_cast<const char*>(&maxCoalescedSize), sizeof(maxCoalescedSize));
+    return ERROR_SUCCESS == error;
+}
+
+// Size of the buffers receiving the control messages of WSARecvMsg, enough for all the control messages requested
+constexpr size_t c_controlBufferSize = 64;
+
+inline LPFN_WSARECVMSG GetWsaRecvMsgFunction(SOCKET socket)
+{
+    LPFN_WSARECVMSG wsaRecvMsg = nullptr;
+    GUID guid = WSAID_WSARECVMSG;
+    DWORD bytesReturned = 0;
+    const auto error = WSAIoctl(
+        socket, SIO_GET_EXTENSION_FUNCTION_POINTER, &guid, sizeof(guid), &wsaRecvMsg, sizeof(wsaRecvMsg), &bytesReturned, nullptr, nullptr);
+    if (SOCKET_ERROR == error)
+    {
+        THROW_WIN32_MSG(WSAGetLastError(), "WSAIoctl(SIO_GET_EXTENSION_FUNCTION_POINTER, WSAID_WSARECVMSG) failed");
+    }
+
+    return wsaRecvMsg;
+}
+
+// Returns the size of each datagram coalesced in a received buffer, or 0 if the buffer holds a single datagram
+inline DWORD GetCoalescedDatagramSize(WSAMSG& message) noexcept
+{
+    for (auto* controlMessage = WSA_CMSG_FIRSTHDR(&message); controlMessage != nullptr;
+         controlMessage = WSA_CMSG_NXTHDR(&message, controlMessage))
+    {
+        if (controlMessage->cmsg_level == IPPROTO_UDP && controlMessage->cmsg_type == UDP_COALESCED_INFO)
+        {
+            return *reinterpret_cast<const DWORD*>(WSA_CMSG_DATA(controlMessage));
+        }
+    }
+
+    return 0;
+}
+
+// Report the ECN field of each received datagram in an IP_ECN (or IPV6_ECN) control message.
+// Returns false if the OS does not support it.
+inline bool TrySetSocketReceiveEcn(SOCKET socket, short family) noexcept
+{
+    const DWORD enable = 1;
+    const auto error = family == AF_INET6
+                           ? setsockopt(socket, IPPROTO_IPV6, IPV6_RECVECN, reinterpret_cast<const char*>(&enable), sizeof(enable))
+                           : setsockopt(socket, IPPROTO_IP, IP_RECVECN, reinterpret_cast<const char*>(&enable), sizeof(enable));
+    return ERROR_SUCCESS == error;
+}
+
+// Returns the ECN field of the received datagram, or -1 if the control messages do not report it
+inline int GetReceivedEcnCodepoint(WSAMSG& message) noexcept
+{
+    for (auto* controlMessage = WSA_CMSG_FIRSTHDR(&message); controlMessage != nullptr;
+         controlMessage = WSA_CMSG_NXTHDR(&message, controlMessage))
+    {
+        if ((controlMessage->cmsg_level == IPPROTO_IP && controlMessage->cmsg_type == IP_ECN) ||
+            (controlMessage->cmsg_level == IPPROTO_IPV6 && controlMessage->cmsg_type == IPV6_ECN))
+        {
+            return *reinterpret_cast<const int*>(WSA_CMSG_DATA(controlMessage));
+        }
+    }
+
+    return -1;
+}
+
+// Set the ECN field of the datagrams sent with WSASendMsg
+inline void SetEcnControl(WSAMSG& message, std::span<char> controlBuffer, short family, int ecnCodepoint) noexcept
+{
+    message.Control.buf = controlBuffer.data();
+    message.Control.len = static_cast<ULONG>(WSA_CMSG_SPACE(sizeof(int)));
+
+    auto* controlMessage = WSA_CMSG_FIRSTHDR(&message);
+    controlMessage->cmsg_level = family == AF_INET6 ? IPPROTO_IPV6 : IPPROTO_IP;
+    controlMessage->cmsg_type = family == AF_INET6 ? IPV6_ECN : IP_ECN;
+    controlMessage->cmsg_len = WSA_CMSG_LEN(sizeof(int));
+    *reinterpret_cast<int*>(WSA_CMSG_DATA(controlMessage)) = ecnCodepoint;
+}
+
+// Ask the network stack to split the buffer sent with WSASendMsg into datagrams of datagramSize bytes
+inline void SetSendMessageSizeControl(WSAMSG& message, std::span<char> controlBuffer, DWORD datagramSize) noexcept
+{
+    message.Control.buf = controlBuffer.data();
+    message.Control.len = static_cast<ULONG>(WSA_CMSG_SPACE(sizeof(DWORD)));
+
+    auto* controlMessage = WSA_CMSG_FIRSTHDR(&message);
+    controlMessage->cmsg_level = IPPROTO_UDP;
+    controlMessage->cmsg_type = UDP_SEND_MSG_SIZE;
+    controlMessage->cmsg_len = WSA_CMSG_LEN(sizeof(DWORD));
+    *reinterpret_cast<DWORD*>(WSA_CMSG_DATA(controlMessage)) = datagramSize;
+}
+
+// Number of received datagrams discarded by the host although a socket was bound to their port, mostly because the
+// socket receive buffer was full. Windows does not expose a per-socket counter: this counts all the UDP sockets
+// of the address family. The counter is 32 bits and wraps around: see CountHostUdpReceiveErrorsSince.
+inline DWORD GetHostUdpReceiveErrors(ADDRESS_FAMILY family)
+{
+    MIB_UDPSTATS2 statistics{};
+    const auto error = GetUdpStatisticsEx2(&statistics, family);
+    if (NO_ERROR != error)
+    {
+        THROW_WIN32_MSG(error, "GetUdpStatisticsEx2 failed");
+    }
+
+    return statistics.dwInErrors;
+}
+
+// Number of received datagrams discarded by the host since GetHostUdpReceiveErrors returned errorsAtStart. The
+// difference is taken in 32 bits, so that it stays right when the counter wrapped around in between.
+inline long long CountHostUdpReceiveErrorsSince(ADDRESS_FAMILY family, DWORD errorsAtStart)
+{
+    return static_cast<long long>(static_cast<DWORD>(GetHostUdpReceiveErrors(family) - errorsAtStart));
+}
+
 inline void SetSocketReceiveBufferSize(SOCKET socket, int size)
 {
     const auto optionValue = size;
@@ -67,4 +211,32 @@ inline void SetSocketReceiveBufferSize(SOCKET socket, int size)
     }
 }
 
+inline void SetSocketSendBufferSize(SOCKET socket, int size)
+{
+    const auto optionValue = size;
+    const auto optionLength = sizeof(optionValue);
+    const auto error = setsockopt(socket, SOL_SOCKET, SO_SNDBUF, reinterpret_cast<const char*>(&optionValue), optionLength);
+    if (ERROR_SUCCESS != error)
+    {
+        THROW_WIN32_MSG(WSAGetLastError(), "setsocktopt(SOL_SOCKET, SO_SNDBUF) failed to set a buffer size of %i", size);
+    }
+}
+
+using unique_qos_handle = wil::unique_any<HANDLE, decltype(&::QOSCloseHandle), ::QOSCloseHandle>;
+
+// Mark the datagrams of a connected socket with the DSCP value and the 802.1p priority of the traffic type.
+// The socket leaves the flow when the returned handle is closed.
+inline unique_qos_handle AddSocketToQosFlow(SOCKET socket, QOS_TRAFFIC_TYPE trafficType)
+{
+    QOS_VERSION version{1, 0};
+    unique_qos_handle qosHandle;
+    THROW_LAST_ERROR_IF_MSG(!QOSCreateHandle(&version, qosHandle.put()), "QOSCreateHandle failed");
+
+    // The socket is connected, the flow takes its destination
+    QOS_FLOWID flowId = 0;
+    THROW_LAST_ERROR_IF_MSG(
+        !QOSAddSocketToFlow(qosHandle.get(), socket, nullptr, trafficType, QOS_NON_ADAPTIVE_FLOW, &flowId), "QOSAddSocketToFlow failed");
+    return qosHandle;
+}
+
 } // namespace multipath
\ No newline at end of file
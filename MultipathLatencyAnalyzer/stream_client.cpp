@@ -4,14 +4,37 @@
 #include "stream_client.h"
 #include "adapters.h"
 #include "logs.h"
+#include "monotonic_clock.h"
+#include "socket_utils.h"
 
 #include <wil/result.h>
 
+#include <algorithm>
+#include <future>
 #include <iostream>
 
 namespace multipath {
 namespace {
 
+    constexpr unsigned long c_autotuneInterval = 10'000'000; // 1 sec, in 100 nanosec
+
+    // A flow only carries a share of the datagrams: its send ring shrinks with the number of flows, down to this size
+    constexpr size_t c_minFlowSendRingCapacity = 16;
+
+    // The threadpool timers are too coarse to pace packet trains: spin until the deadline
+    void SpinUntil(long long timestamp) noexcept
+    {
+        while (SnapMonotonicNanoSec() < timestamp)
+        {
+            YieldProcessor();
+        }
+    }
+
+    // The end-of-run drain lasts a multiple of the 99.9th percentile of the round-trip times, within bounds
+    constexpr long long c_drainRoundTripTimeMultiple = 4;
+    constexpr long long c_minDrainDuration = 50'000'000;    // 50 msec
+    constexpr long long c_maxDrainDuration = 5'000'000'000; // 5 sec
+
     // calculates the interval at which to set the timer callback to send data at the specified rate (in bits per second)
     constexpr long long CalculateTickInterval(long long bitRate, long long grouping, unsigned long long datagramSize) noexcept
     {
@@ -32,10 +55,16 @@ namespace {
 
 } // namespace
 
-StreamClient::StreamClient(ctl::ctSockaddr targetAddress, unsigned long receiveBufferCount, HANDLE completeEvent) :
-    m_targetAddress(std::move(targetAddress)), m_completeEvent(completeEvent), m_receiveBufferCount(receiveBufferCount)
+StreamClient::StreamClient(
+    ctl::ctSockaddr targetAddress, unsigned long receiveBufferCount, bool udpOffload, bool autotune, HANDLE completeEvent) :
+    m_targetAddress(std::move(targetAddress)),
+    m_completeEvent(completeEvent),
+    m_receiveBufferCount(receiveBufferCount),
+    m_udpOffload(udpOffload),
+    m_autotune(autotune)
 {
     m_threadpoolTimer = std::make_unique<ThreadpoolTimer>([this]() noexcept { TimerCallback(); });
+    m_autotuneTimer = std::make_unique<ThreadpoolTimer>([this]() noexcept { AutotuneSockets(); });
 }
 
 void StreamClient::RequestSecondaryWlanConnection()
@@ -50,6 +79,168 @@ void StreamClient::RequestSecondaryWlanConnection()
     }
 }
 
+void StreamClient::EnableFrameMetrics() noexcept
+{
+    m_frameMetrics = true;
+}
+
+void StreamClient::EnableLoadFlow(Interface interface, unsigned long bitRate) noexcept
+{
+    m_loadInterface = interface;
+    m_loadBitRate = bitRate;
+}
+
+void StreamClient::EnableTrafficClasses(const std::vector<TrafficClass>& classes)
+{
+    m_trafficClasses = classes;
+    m_flowCount = classes.size();
+    const auto stride = static_cast<long long>(m_flowCount);
+    m_primaryState.SetTrafficClass(classes.front());
+    m_secondaryState.SetTrafficClass(classes.front());
+    m_primaryState.SetSequenceStride(stride);
+    m_secondaryState.SetSequenceStride(stride);
+    for (size_t i = 1; i < classes.size(); ++i)
+    {
+        for (const auto interface : {Interface::Primary, Interface::Secondary})
+        {
+            auto& flowSocket = GetFlowSockets(interface).emplace_back(std::make_unique<MeasuredSocket>());
+            flowSocket->SetTrafficClass(classes[i]);
+            flowSocket->SetEcnCodepoint(m_ecnCodepoint);
+            flowSocket->SharePathStatistics(interface == Interface::Primary ? m_primaryState : m_secondaryState);
+        }
+    }
+}
+
+void StreamClient::EnableFlows(size_t flowCount)
+{
+    m_flowCount = flowCount;
+    const auto stride = static_cast<long long>(flowCount);
+    const auto sendRingCapacity = (std::max)(MeasuredSocket::c_sendRingCapacity / flowCount, c_minFlowSendRingCapacity);
+    m_primaryState.SetSequenceStride(stride);
+    m_secondaryState.SetSequenceStride(stride);
+    for (size_t i = 1; i < flowCount; ++i)
+    {
+        for (const auto interface : {Interface::Primary, Interface::Secondary})
+        {
+            auto& flowSocket = GetFlowSockets(interface).emplace_back(std::make_unique<MeasuredSocket>(sendRingCapacity));
+            flowSocket->SetEcnCodepoint(m_ecnCodepoint);
+            flowSocket->SharePathStatistics(interface == Interface::Primary ? m_primaryState : m_secondaryState);
+        }
+    }
+}
+
+std::vector<long long> StreamClient::ProbeTargetAddresses(const std::vector<ctl::ctSockaddr>& targetAddresses)
+{
+    std::vector<std::unique_ptr<MeasuredSocket>> sockets;
+    std::vector<std::future<long long>> probes;
+    for (const auto& targetAddress : targetAddresses)
+    {
+        auto* socket = sockets.emplace_back(std::make_unique<MeasuredSocket>(c_minFlowSendRingCapacity)).get();
+        probes.push_back(std::async(std::launch::async, [socket, &targetAddress]() -> long long {
+            try
+            {
+                socket->Setup(targetAddress, 1, false);
+                socket->CheckConnectivity();
+                return socket->GetHandshakeRoundTripTime();
+            }
+            catch (...)
+            {
+                LOG_CAUGHT_EXCEPTION_MSG("Failed to probe a target address");
+                return -1;
+            }
+        }));
+    }
+
+    std::vector<long long> roundTripTimes;
+    for (auto& probe : probes)
+    {
+        roundTripTimes.push_back(probe.get());
+    }
+    return roundTripTimes;
+}
+
+void StreamClient::EnableTargets(const std::vector<ctl::ctSockaddr>& targetAddresses)
+{
+    EnableFlows(targetAddresses.size() + 1);
+    m_flowTargetAddresses = targetAddresses;
+}
+
+void StreamClient::EnableEcn(EcnCodepoint ecnCodepoint) noexcept
+{
+    m_ecnCodepoint = ecnCodepoint;
+    m_primaryState.SetEcnCodepoint(ecnCodepoint);
+    m_secondaryState.SetEcnCodepoint(ecnCodepoint);
+    for (auto* flowSockets : {&m_primaryFlowSockets, &m_secondaryFlowSockets})
+    {
+        for (auto& flowSocket : *flowSockets)
+        {
+            flowSocket->SetEcnCodepoint(ecnCodepoint);
+        }
+    }
+}
+
+void StreamClient::SetupFlowSockets(const Interface interface)
+{
+    const auto& state = interface == Interface::Primary ? m_primaryState : m_secondaryState;
+
+    // Each flow receives one datagram out of m_flowCount, the autotuner posts more receives if needed
+    const auto receiveBufferCount =
+        m_trafficClasses.empty() ? (std::max)(m_receiveBufferCount / static_cast<unsigned long>(m_flowCount), 1UL) : m_receiveBufferCount;
+    auto& flowSockets = interface == Interface::Primary ? m_primaryFlowSockets : m_secondaryFlowSockets;
+    for (size_t i = 0; i < flowSockets.size(); ++i)
+    {
+        auto& flowSocket = flowSockets[i];
+        const auto& targetAddress = m_flowTargetAddresses.empty() ? m_targetAddress : m_flowTargetAddresses[i];
+        flowSocket->Setup(targetAddress, receiveBufferCount, m_udpOffload, state.GetInterfaceIndex());
+    }
+
+    // The path socket already confirmed the connectivity of the interface. A flow that a load balancer along the
+    // path drops is a result of the measure, not a setup failure, and checking thousands of flows would take long.
+    if (m_trafficClasses.empty() && m_flowTargetAddresses.empty())
+    {
+        return;
+    }
+
+    // Check the sockets in parallel, so that the unreachable ones do not add up their timeouts
+    std::vector<std::future<void>> checks;
+    for (const auto& flowSocket : flowSockets)
+    {
+        checks.push_back(std::async(std::launch::async, [socket = flowSocket.get()]() { socket->CheckConnectivity(); }));
+    }
+
+    for (size_t i = 0; i < checks.size(); ++i)
+    {
+        if (!m_trafficClasses.empty())
+        {
+            checks[i].get();
+            continue;
+        }
+
+        // An unreachable target does not prevent measuring the others, its datagrams count as lost
+        try
+        {
+            checks[i].get();
+        }
+        catch (...)
+        {
+            LOG_CAUGHT_EXCEPTION_MSG("A target could not be reached");
+            Log<LogLevel::Output>(
+                "%ls could not be reached on the %s interface\n",
+                m_flowTargetAddresses[i].WriteCompleteAddress().c_str(),
+                interface == Interface::Primary ? "primary" : "secondary");
+        }
+    }
+}
+
+void StreamClient::CancelPath(const Interface interface) noexcept
+{
+    (interface == Interface::Primary ? m_primaryState : m_secondaryState).Cancel();
+    for (auto& flowSocket : interface == Interface::Primary ? m_primaryFlowSockets : m_secondaryFlowSockets)
+    {
+        flowSocket->Cancel();
+    }
+}
+
 void StreamClient::SetupSecondaryInterface()
 {
     if (!m_wlanHandle)
@@ -77,7 +268,7 @@ void StreamClient::SetupSecondaryInterface()
                 // If a secondary wlan interface was used for the previous primary, tear it down
                 if (m_secondaryState.m_adapterStatus == MeasuredSocket::AdapterStatus::Ready)
                 {
-                    m_secondaryState.Cancel();
+                    CancelPath(Interface::Secondary);
                     Log<LogLevel::Dualsta>("Secondary interface removed\n");
                 }
 
@@ -100,12 +291,13 @@ void StreamClient::SetupSecondaryInterface()
                 try
                 {
                     Log<LogLevel::Dualsta>("Secondary interface connected. Setting up a socket.\n");
-                    m_secondaryState.Setup(m_targetAddress, m_receiveBufferCount, ConvertInterfaceGuidToIndex(secondaryInterfaceGuid));
+                    m_secondaryState.Setup(
+                        m_targetAddress, m_receiveBufferCount, m_udpOffload, ConvertInterfaceGuidToIndex(secondaryInterfaceGuid));
                     m_secondaryState.CheckConnectivity();
-                    m_secondaryState.PrepareToReceive([this](auto& r) { ReceiveCompletion(Interface::Secondary, r); });
+                    SetupFlowSockets(Interface::Secondary);
 
                     // The secondary interface is ready to send data, the client can start using it
-                    m_secondaryState.m_adapterStatus = MeasuredSocket::AdapterStatus::Ready;
+                    StartPath(Interface::Secondary);
                     Log<LogLevel::Info>("Secondary interface ready for use.\n");
                 }
                 catch (wil::ResultException& ex)
@@ -116,7 +308,7 @@ void StreamClient::SetupSecondaryInterface()
                         Log<LogLevel::Dualsta>(
                             "Secondary interface could not reach the echo server. It will retry after a "
                             "network status change.");
-                        m_secondaryState.Cancel();
+                        CancelPath(Interface::Secondary);
                         m_secondaryState.m_adapterStatus = MeasuredSocket::AdapterStatus::Connecting;
                     }
                     else
@@ -127,7 +319,7 @@ void StreamClient::SetupSecondaryInterface()
             }
             else if (m_secondaryState.m_adapterStatus == MeasuredSocket::AdapterStatus::Ready && !IsAdapterConnected(secondaryInterfaceGuid))
             {
-                m_secondaryState.Cancel();
+                CancelPath(Interface::Secondary);
                 Log<LogLevel::Dualsta>("Secondary interface removed after losing connectivity\n");
             }
         }
@@ -147,60 +339,613 @@ void StreamClient::SetupSecondaryInterface()
         });
 }
 
-void StreamClient::Start(unsigned long bitRate, unsigned long grouping, unsigned long duration)
+void StreamClient::Start(
+    unsigned long bitRate, unsigned long grouping, unsigned long duration, TimerOverrunPolicy overrunPolicy, PredictorModel predictorModel)
 {
     m_grouping = grouping;
-    const auto tickInterval = CalculateTickInterval(bitRate, grouping, MeasuredSocket::c_bufferSize);
+    m_overrunPolicy = overrunPolicy;
+    m_bitRate = bitRate;
+    m_tickInterval = CalculateTickInterval(bitRate, grouping, MeasuredSocket::c_bufferSize);
     const auto nbDatagramToSend = CalculateNumberOfDatagramToSend(duration, bitRate, MeasuredSocket::c_bufferSize);
     m_finalSequenceNumber += nbDatagramToSend;
 
-    // allocate statistics buffer
+    // allocate statistics buffer, per flow when there are several: the latency data is only filled when the run stops
     FAIL_FAST_IF_MSG(m_finalSequenceNumber > MAXSIZE_T, "Final sequence number exceeds limit of vector storage");
-    m_latencyData.m_latencies.resize(static_cast<size_t>(m_finalSequenceNumber));
+    if (m_flowCount <= 1)
+    {
+        m_latencyData.m_primary.m_latencies.resize(static_cast<size_t>(m_finalSequenceNumber));
+        m_latencyData.m_secondary.m_latencies.resize(static_cast<size_t>(m_finalSequenceNumber));
+    }
+    else
+    {
+        const auto datagramsPerFlow = (static_cast<size_t>(m_finalSequenceNumber) + m_flowCount - 1) / m_flowCount;
+        for (auto* flowLatencies : {&m_primaryFlowLatencies, &m_secondaryFlowLatencies})
+        {
+            flowLatencies->assign(m_flowCount, FlowLatencies(datagramsPerFlow));
+        }
+    }
+    m_latencyData.m_datagramSize = MeasuredSocket::c_bufferSize;
+    if (m_frameMetrics)
+    {
+        m_frameTracker.Initialize(m_finalSequenceNumber, m_grouping);
+    }
+
+    Log<LogLevel::Output>(
+        "%d datagrams will be sent, by groups of %d every %lld microseconds\n", nbDatagramToSend, m_grouping, m_tickInterval / 10);
+
+    Connect(predictorModel);
+}
+
+void StreamClient::SearchCapacity(
+    const CapacitySearchSettings& settings, unsigned long grouping, TimerOverrunPolicy overrunPolicy, PredictorModel predictorModel)
+{
+    m_probing = true;
+    m_grouping = grouping;
+    m_overrunPolicy = overrunPolicy;
+
+    // Each trial uses the next sequence numbers, the statistics buffer must hold the longest possible search on
+    // each interface: the receive completions of a previous trial could still be writing to it.
+    const auto maxTrialDatagrams =
+        CalculateNumberOfDatagramToSend(settings.m_trialDuration, settings.m_maxBitRate, MeasuredSocket::c_bufferSize);
+    const auto maxDatagrams = maxTrialDatagrams * static_cast<long long>(CapacitySearch::c_maxTrials) * 2;
+    FAIL_FAST_IF_MSG(maxDatagrams > MAXSIZE_T, "Final sequence number exceeds limit of vector storage");
+    m_latencyData.m_primary.m_latencies.resize(static_cast<size_t>(maxDatagrams));
+    m_latencyData.m_secondary.m_latencies.resize(static_cast<size_t>(maxDatagrams));
+    m_latencyData.m_datagramSize = MeasuredSocket::c_bufferSize;
+    m_finalSequenceNumber = 0;
+
+    Connect(predictorModel);
+
+    for (const auto interface : {Interface::Primary, Interface::Secondary})
+    {
+        const auto* interfaceName = interface == Interface::Primary ? "primary" : "secondary";
+        const auto& state = interface == Interface::Primary ? m_primaryState : m_secondaryState;
+        if (state.m_adapterStatus != MeasuredSocket::AdapterStatus::Ready)
+        {
+            Log<LogLevel::Output>("The %s interface cannot reach the server, its capacity is not searched\n", interfaceName);
+            continue;
+        }
+
+        Log<LogLevel::Output>("Searching the capacity of the %s interface\n", interfaceName);
+        m_sendOnPrimary = interface == Interface::Primary;
+        m_sendOnSecondary = interface == Interface::Secondary;
+
+        CapacitySearch search{settings};
+        while (const auto bitRate = search.GetNextBitRate())
+        {
+            const auto trial = RunCapacityTrial(search, interface, bitRate, settings.m_trialDuration);
+            Log<LogLevel::Output>(
+                "%lu kbps on the %s interface: %lld datagrams sent, %lld received, 99th percentile latency %lld us -> %s\n",
+                trial.m_bitRate / 1024,
+                interfaceName,
+                trial.m_sentDatagrams,
+                trial.m_receivedDatagrams,
+                trial.m_latency99 / 1000,
+                trial.m_passed ? "passed" : "failed");
+        }
+
+        (interface == Interface::Primary ? m_primaryCapacitySearch : m_secondaryCapacitySearch) = std::move(search);
+    }
+
+    Stop();
+}
+
+void StreamClient::SendForDuration(unsigned long bitRate, unsigned long duration)
+{
+    // Forget the end of the previous measurement
+    ResetOutstandingDatagrams();
+    m_trialSentEvent.ResetEvent();
+
+    m_bitRate = bitRate;
+    m_tickInterval = CalculateTickInterval(bitRate, m_grouping, MeasuredSocket::c_bufferSize);
+    m_finalSequenceNumber = m_sequenceNumber + CalculateNumberOfDatagramToSend(duration, bitRate, MeasuredSocket::c_bufferSize);
+    FAIL_FAST_IF_MSG(
+        m_finalSequenceNumber > static_cast<long long>(m_latencyData.m_primary.m_latencies.size()),
+        "Exceeded the statistics buffer");
+
+    m_threadpoolTimer->Schedule(static_cast<unsigned long>(m_tickInterval), m_overrunPolicy);
+
+    // As the client mode, give up when sending takes twice as long as expected
+    if (!m_trialSentEvent.wait(duration * 2 * 1000))
+    {
+        Log<LogLevel::Error>("Timed out waiting for the datagrams to be sent\n");
+    }
+    m_threadpoolTimer->StopAndWait();
+
+    DrainOutstandingDatagrams();
+}
+
+CapacityTrial StreamClient::RunCapacityTrial(
+    CapacitySearch& search, const Interface interface, unsigned long bitRate, unsigned long duration)
+{
+    const auto firstSequenceNumber = m_sequenceNumber;
+    SendForDuration(bitRate, duration);
+
+    const auto& latencies = GetPathLatencyData(interface).m_latencies;
+    long long sentDatagrams = 0;
+    std::vector<long long> trialLatencies;
+    for (auto i = firstSequenceNumber; i < m_sequenceNumber; ++i)
+    {
+        const auto& stat = latencies[static_cast<size_t>(i)];
+        if (stat.m_sendTimestamp >= 0)
+        {
+            sentDatagrams += 1;
+        }
+        if (stat.m_receiveTimestamp >= 0)
+        {
+            trialLatencies.push_back(stat.m_receiveTimestamp - stat.m_sendTimestamp);
+        }
+    }
+
+    long long latency99 = 0;
+    if (!trialLatencies.empty())
+    {
+        const auto rank = (std::min)(trialLatencies.size() - 1, trialLatencies.size() * 99 / 100);
+        std::ranges::nth_element(trialLatencies, trialLatencies.begin() + static_cast<std::ptrdiff_t>(rank));
+        latency99 = trialLatencies[rank];
+    }
+
+    return search.AddTrial(bitRate, sentDatagrams, static_cast<long long>(trialLatencies.size()), latency99);
+}
+
+void StreamClient::RunScenario(const std::vector<ScenarioPhase>& phases, PredictorModel predictorModel)
+{
+    m_probing = true;
+
+    // The phases use consecutive sequence numbers
+    long long totalDatagrams = 0;
+    for (const auto& phase : phases)
+    {
+        totalDatagrams += CalculateNumberOfDatagramToSend(phase.m_duration, phase.m_bitRate, MeasuredSocket::c_bufferSize);
+    }
+    FAIL_FAST_IF_MSG(totalDatagrams > MAXSIZE_T, "Final sequence number exceeds limit of vector storage");
+    m_latencyData.m_primary.m_latencies.resize(static_cast<size_t>(totalDatagrams));
+    m_latencyData.m_secondary.m_latencies.resize(static_cast<size_t>(totalDatagrams));
+    m_latencyData.m_datagramSize = MeasuredSocket::c_bufferSize;
+    m_finalSequenceNumber = 0;
+
+    Connect(predictorModel);
+
+    for (const auto& phase : phases)
+    {
+        Log<LogLevel::Output>(
+            "Starting phase %ls: %lu kbps, by groups of %lu, for %lu seconds\n",
+            phase.m_name.c_str(),
+            phase.m_bitRate / 1024,
+            phase.m_grouping,
+            phase.m_duration);
+        m_grouping = phase.m_grouping;
+        m_overrunPolicy = phase.m_overrunPolicy;
+        m_sendOnPrimary = phase.m_duplication != DuplicationPolicy::Secondary;
+        m_sendOnSecondary = phase.m_duplication != DuplicationPolicy::Primary;
+
+        // The counters of the whole run, to subtract from those at the end of the phase
+        const auto firstSequenceNumber = m_sequenceNumber;
+        const auto hostReceiveErrors = GetHostReceiveErrors();
+        LatencyData countersAtStart;
+        CaptureSocketStatistics(countersAtStart);
+        m_threadpoolTimer->ResetStatistics();
+
+        SendForDuration(phase.m_bitRate, phase.m_duration);
+
+        ScenarioPhaseResult result{phase.m_name};
+        auto& data = result.m_data;
+        data.m_datagramSize = MeasuredSocket::c_bufferSize;
+        data.m_hostReceiveDrops = CountHostReceiveDropsSince(hostReceiveErrors);
+        CaptureTimerStatistics(data);
+        CaptureSocketStatistics(data);
+        for (const auto interface : {Interface::Primary, Interface::Secondary})
+        {
+            const auto& latencies = GetPathLatencyData(interface).m_latencies;
+            auto& phaseData = interface == Interface::Primary ? data.m_primary : data.m_secondary;
+            const auto& pathCountersAtStart = interface == Interface::Primary ? countersAtStart.m_primary : countersAtStart.m_secondary;
+            phaseData.m_latencies.assign(latencies.begin() + firstSequenceNumber, latencies.begin() + m_sequenceNumber);
+            phaseData.m_corruptDatagrams -= pathCountersAtStart.m_corruptDatagrams;
+            phaseData.m_lateDatagrams -= pathCountersAtStart.m_lateDatagrams;
+            phaseData.m_sendRingDrops -= pathCountersAtStart.m_sendRingDrops;
+        }
+
+        m_scenarioResults.push_back(std::move(result));
+    }
+
+    Stop();
+}
+
+void StreamClient::ProbeBandwidth(const BandwidthProbeSettings& settings, PredictorModel predictorModel)
+{
+    m_probing = true;
+
+    const auto datagramsPerInterface = settings.m_pairCount * 2 + settings.m_trainCount * settings.m_trainLength;
+    m_latencyData.m_primary.m_latencies.resize(datagramsPerInterface * 2);
+    m_latencyData.m_secondary.m_latencies.resize(datagramsPerInterface * 2);
     m_latencyData.m_datagramSize = MeasuredSocket::c_bufferSize;
 
-    // Setup the interfaces
+    Connect(predictorModel);
+
+    for (const auto interface : {Interface::Primary, Interface::Secondary})
+    {
+        const auto* interfaceName = interface == Interface::Primary ? "primary" : "secondary";
+        const auto& state = interface == Interface::Primary ? m_primaryState : m_secondaryState;
+        if (state.m_adapterStatus != MeasuredSocket::AdapterStatus::Ready)
+        {
+            Log<LogLevel::Output>("The %s interface cannot reach the server, its bandwidth is not probed\n", interfaceName);
+            continue;
+        }
+
+        Log<LogLevel::Output>("Probing the bandwidth of the %s interface\n", interfaceName);
+        (interface == Interface::Primary ? m_primaryBandwidthEstimate : m_secondaryBandwidthEstimate) =
+            ProbePathBandwidth(interface, settings);
+    }
+
+    Stop();
+}
+
+BandwidthEstimate StreamClient::ProbePathBandwidth(const Interface interface, const BandwidthProbeSettings& settings)
+{
+    const auto& latencies = GetPathLatencyData(interface).m_latencies;
+    const auto datagramSize = MeasuredSocket::c_bufferSize;
+    BandwidthEstimate estimate;
+
+    // Packet pairs, sent back to back: the bottleneck spaces them by its transmission time
+    const auto firstPairSequenceNumber = m_sequenceNumber;
+    ResetOutstandingDatagrams();
+    for (unsigned long i = 0; i < settings.m_pairCount; ++i)
+    {
+        SendPacedDatagrams(interface, 2, 0);
+        SpinUntil(SnapMonotonicNanoSec() + settings.m_pairSpacing);
+    }
+    DrainOutstandingDatagrams();
+
+    estimate.m_sentPairs = settings.m_pairCount;
+    estimate.m_capacity = EstimateCapacity(
+        std::span{latencies.data() + firstPairSequenceNumber, settings.m_pairCount * 2}, datagramSize, estimate.m_validPairs);
+    if (estimate.m_capacity <= 0.)
+    {
+        return estimate;
+    }
+
+    // Packet trains paced at increasing fractions of the capacity: a train sent faster than the available bandwidth
+    // queues behind the cross traffic and reaches the server slower than it was sent
+    const auto firstTrainSequenceNumber = m_sequenceNumber;
+    ResetOutstandingDatagrams();
+    for (unsigned long i = 1; i <= settings.m_trainCount; ++i)
+    {
+        const auto rate = estimate.m_capacity * i / settings.m_trainCount;
+        const auto gap = static_cast<long long>(datagramSize * 8 * c_nanoSecInSecond / rate);
+        SendPacedDatagrams(interface, settings.m_trainLength, gap);
+        SpinUntil(SnapMonotonicNanoSec() + settings.m_trainSpacing);
+    }
+    DrainOutstandingDatagrams();
+
+    for (unsigned long i = 0; i < settings.m_trainCount; ++i)
+    {
+        const auto first = static_cast<size_t>(firstTrainSequenceNumber) + i * settings.m_trainLength;
+        estimate.m_trains.push_back(MeasurePacketTrain(std::span{latencies.data() + first, settings.m_trainLength}, datagramSize));
+    }
+    estimate.m_availableBandwidth = EstimateAvailableBandwidth(estimate.m_trains);
+    return estimate;
+}
+
+void StreamClient::SendPacedDatagrams(const Interface interface, long long count, long long gap) noexcept
+{
+    auto& state = interface == Interface::Primary ? m_primaryState : m_secondaryState;
+    auto& outstandingDatagrams = GetOutstandingDatagrams(interface);
+    const auto sendCompletion = [this, interface](const auto& r) { SendCompletion(interface, r); };
+
+    if (gap == 0)
+    {
+        outstandingDatagrams += state.SendDatagrams(m_sequenceNumber, count, sendCompletion);
+        m_sequenceNumber += count;
+        return;
+    }
+
+    const auto start = SnapMonotonicNanoSec();
+    for (long long i = 0; i < count; ++i)
+    {
+        SpinUntil(start + i * gap);
+        outstandingDatagrams += state.SendDatagrams(m_sequenceNumber, 1, sendCompletion);
+        m_sequenceNumber += 1;
+    }
+}
+
+void StreamClient::ResetOutstandingDatagrams() noexcept
+{
+    m_firstOutstandingSequenceNumber = m_sequenceNumber;
+    m_primaryOutstandingDatagrams = 0;
+    m_secondaryOutstandingDatagrams = 0;
+    m_draining = false;
+    m_drainDeadline = LLONG_MAX;
+    m_drainedEvent.ResetEvent();
+}
+
+void StreamClient::Connect(PredictorModel predictorModel)
+{
+    m_hostReceiveErrorsAtStart = GetHostReceiveErrors();
+    m_autotuneHostReceiveErrors = m_hostReceiveErrorsAtStart;
+
+    m_primaryState.SetPredictorModel(predictorModel);
+    m_secondaryState.SetPredictorModel(predictorModel);
+
+    // Setup the interfaces. The connectivity of the primary interface is checked in the background while the
+    // secondary interface is setup: sending starts as soon as either one reaches the server.
     Log<LogLevel::Info>("Setting up the interfaces\n");
-    m_primaryState.Setup(m_targetAddress, m_receiveBufferCount);
-    m_primaryState.CheckConnectivity();
+    m_primaryState.Setup(m_targetAddress, m_receiveBufferCount, m_udpOffload);
+    auto primaryConnectivity = std::async(std::launch::async, [this]() {
+        m_primaryState.CheckConnectivity();
+        SetupFlowSockets(Interface::Primary);
+        StartPath(Interface::Primary);
+    });
 
     SetupSecondaryInterface();
 
-    // initiate receives before starting the send timer
-    m_primaryState.PrepareToReceive([this](auto& r) { ReceiveCompletion(Interface::Primary, r); });
-    m_primaryState.m_adapterStatus = MeasuredSocket::AdapterStatus::Ready;
+    try
+    {
+        primaryConnectivity.get();
+    }
+    catch (...)
+    {
+        // Carry on with the secondary interface alone if it could reach the server
+        if (m_secondaryState.m_adapterStatus != MeasuredSocket::AdapterStatus::Ready)
+        {
+            throw;
+        }
 
-    Log<LogLevel::Output>(
-        "%d datagrams will be sent, by groups of %d every %lld microseconds\n", nbDatagramToSend, m_grouping, tickInterval / 10);
+        LOG_CAUGHT_EXCEPTION_MSG("The primary interface could not reach the server");
+        Log<LogLevel::Output>("The primary interface could not reach the server, only the secondary interface is used\n");
+    }
 
-    // start sending data
-    Log<LogLevel::Info>("Start sending datagrams\n");
-    // TODO: Clean types
-    m_threadpoolTimer->Schedule(static_cast<unsigned long>(tickInterval));
+    // The autotuner takes the locks of all the sockets and changes their options: keep it off the send timer
+    if (m_autotune)
+    {
+        m_autotuneTimer->Schedule(c_autotuneInterval, TimerOverrunPolicy::Skip);
+    }
+}
+
+void StreamClient::StartPath(const Interface interface) noexcept
+{
+    auto& state = interface == Interface::Primary ? m_primaryState : m_secondaryState;
+
+    if (m_loadInterface == interface && !m_loadFlow)
+    {
+        CreateLoadFlow();
+    }
+
+    // initiate receives before sending
+    state.PrepareToReceive([this, interface](auto& r) { ReceiveCompletion(interface, r); });
+    for (auto& flowSocket : interface == Interface::Primary ? m_primaryFlowSockets : m_secondaryFlowSockets)
+    {
+        flowSocket->PrepareToReceive([this, interface](auto& r) { ReceiveCompletion(interface, r); });
+        flowSocket->m_adapterStatus = MeasuredSocket::AdapterStatus::Ready;
+    }
+    state.m_adapterStatus = MeasuredSocket::AdapterStatus::Ready;
+
+    // A capacity search, a bandwidth probe or a scenario sends itself once the interfaces are connected
+    if (m_probing)
+    {
+        return;
+    }
+
+    std::call_once(m_startSending, [this, interface]() noexcept {
+        Log<LogLevel::Info>(
+            "Start sending datagrams, the %s interface is ready first\n", interface == Interface::Primary ? "primary" : "secondary");
+        // TODO: Clean types
+        m_threadpoolTimer->Schedule(static_cast<unsigned long>(m_tickInterval), m_overrunPolicy);
+    });
 }
 
 void StreamClient::Stop() noexcept
 {
     Log<LogLevel::Info>("Stop sending datagrams\n");
     m_threadpoolTimer->Stop();
+    m_autotuneTimer->StopAndWait();
+    if (m_loadFlow)
+    {
+        m_loadFlow->Stop();
+    }
+
+    CaptureTimerStatistics(m_latencyData);
 
     Log<LogLevel::Info>("Canceling network status changed event subscription\n");
     m_networkInformationEventRevoker.revoke();
 
-    // Wait a little for in-flight packets (we don't want to count them as lost)
-    Sleep(1000); // 1 sec
+    // Wait for in-flight packets (we don't want to count them as lost)
+    DrainOutstandingDatagrams();
+
+    try
+    {
+        m_latencyData.m_hostReceiveDrops = CountHostReceiveDropsSince(m_hostReceiveErrorsAtStart);
+    }
+    catch (...)
+    {
+        LOG_CAUGHT_EXCEPTION_MSG("Failed to read the host receive drop counter");
+    }
+
+    CaptureSocketStatistics(m_latencyData);
+    for (const auto interface : {Interface::Primary, Interface::Secondary})
+    {
+        auto& state = interface == Interface::Primary ? m_primaryState : m_secondaryState;
+        const auto prediction = state.PredictPath();
+        Log<LogLevel::Info>(
+            "Final %s interface prediction: %lld us (+/- %lld us), loss probability %.4f, confidence %.2f\n",
+            interface == Interface::Primary ? "primary" : "secondary",
+            prediction.m_latency / 1000,
+            prediction.m_deviation / 1000,
+            prediction.m_lossProbability,
+            prediction.m_confidence);
+    }
 
     Log<LogLevel::Info>("Closing the sockets\n");
-    m_primaryState.Cancel();
-    m_secondaryState.Cancel();
+    CancelPath(Interface::Primary);
+    CancelPath(Interface::Secondary);
+    JoinFlowLatencies();
 
     Log<LogLevel::Info>("The client has stopped\n");
     SetEvent(m_completeEvent);
 }
 
-void StreamClient::PrintStatistics()
+void StreamClient::CaptureTimerStatistics(LatencyData& data) const noexcept
+{
+    const auto& timerLateness = m_threadpoolTimer->GetLateness();
+    data.m_timerTicks = m_threadpoolTimer->GetTickCount();
+    data.m_lateTimerTicks = m_threadpoolTimer->GetLateTickCount();
+    data.m_skippedTimerTicks = m_threadpoolTimer->GetSkippedTickCount();
+    data.m_timerLatenessMedian = timerLateness.GetPercentile(50);
+    data.m_timerLateness99 = timerLateness.GetPercentile(99);
+    data.m_timerLateness999 = timerLateness.GetPercentile(99.9);
+    data.m_timerLatenessMaximum = timerLateness.GetPercentile(100);
+}
+
+void StreamClient::CaptureSocketStatistics(LatencyData& data) noexcept
+{
+    for (const auto interface : {Interface::Primary, Interface::Secondary})
+    {
+        auto& state = interface == Interface::Primary ? m_primaryState : m_secondaryState;
+        auto& pathData = interface == Interface::Primary ? data.m_primary : data.m_secondary;
+        pathData.m_predictionErrorMedian = state.GetPredictionErrorPercentile(50);
+        pathData.m_predictionError99 = state.GetPredictionErrorPercentile(99);
+        pathData.m_predictionError999 = state.GetPredictionErrorPercentile(99.9);
+
+        const auto tuning = state.GetTuningState();
+        pathData.m_socketBufferSize = tuning.m_socketBufferSize;
+        pathData.m_receiveDepth = tuning.m_receiveDepth;
+        pathData.m_sendRingDrops = GetSendRingDrops(interface);
+
+        const auto& receiveCounters = GetReceiveCounters(interface);
+        pathData.m_corruptDatagrams = receiveCounters.m_corruptDatagrams;
+        pathData.m_lateDatagrams = receiveCounters.m_lateDatagrams;
+    }
+}
+
+long long StreamClient::GetSendRingDrops(const Interface interface) noexcept
+{
+    auto sendRingDrops = (interface == Interface::Primary ? m_primaryState : m_secondaryState).GetSendRingDrops();
+    for (auto& flowSocket : interface == Interface::Primary ? m_primaryFlowSockets : m_secondaryFlowSockets)
+    {
+        sendRingDrops += flowSocket->GetSendRingDrops();
+    }
+    return sendRingDrops;
+}
+
+void StreamClient::DrainOutstandingDatagrams() noexcept
+{
+    // Without any measure, assume the worst. The flows record their round-trip times in the histogram of their path
+    // socket: the flows to distant targets are part of the percentile.
+    const auto roundTripTime =
+        (std::max)(m_primaryState.GetRoundTripTimePercentile(99.9), m_secondaryState.GetRoundTripTimePercentile(99.9));
+    const auto drainDuration = roundTripTime > 0
+                                   ? std::clamp(c_drainRoundTripTimeMultiple * roundTripTime, c_minDrainDuration, c_maxDrainDuration)
+                                   : c_maxDrainDuration;
+    const auto drainDurationMs = static_cast<DWORD>(drainDuration / 1'000'000);
+
+    const auto drainStart = SnapMonotonicNanoSec();
+    m_draining = true;
+    if (!IsDrained())
+    {
+        m_drainedEvent.wait(drainDurationMs);
+    }
+
+    // Keep listening as long again: the datagrams received now are counted as late rather than lost
+    if (!IsDrained())
+    {
+        m_drainDeadline = SnapMonotonicNanoSec();
+        m_drainedEvent.wait(drainDurationMs);
+    }
+
+    Log<LogLevel::Info>(
+        "Waited %lld ms for the datagrams in flight (drain window: %lu ms), %lld datagrams still outstanding\n",
+        (SnapMonotonicNanoSec() - drainStart) / 1'000'000,
+        drainDurationMs,
+        (std::max)(m_primaryOutstandingDatagrams.load(), 0LL) + (std::max)(m_secondaryOutstandingDatagrams.load(), 0LL));
+}
+
+bool StreamClient::IsDrained() const noexcept
+{
+    return m_primaryOutstandingDatagrams <= 0 && m_secondaryOutstandingDatagrams <= 0;
+}
+
+void StreamClient::PrintStatistics(const std::vector<unsigned long>& deadlines)
+{
+    PrintLatencyStatistics(m_latencyData, deadlines);
+    m_frameTracker.PrintStatistics(m_latencyData);
+    PrintTrafficClassStatistics(m_latencyData, m_trafficClasses);
+    if (m_trafficClasses.empty() && m_flowCount > 1)
+    {
+        // The flows are named after their target when they have different ones
+        auto flowName = [this](size_t flow) {
+            if (m_flowTargetAddresses.empty())
+            {
+                return "Flow " + std::to_string(flow);
+            }
+            char address[ctl::c_ipStringMaxLength]{};
+            (flow == 0 ? m_targetAddress : m_flowTargetAddresses[flow - 1]).WriteCompleteAddress(address);
+            return "Target " + std::string{address};
+        };
+
+        std::vector<FlowDescription> flows{{flowName(0), m_primaryState.GetLocalPort(), m_secondaryState.GetLocalPort()}};
+        for (size_t i = 0; i < m_primaryFlowSockets.size(); ++i)
+        {
+            flows.push_back({flowName(i + 1), m_primaryFlowSockets[i]->GetLocalPort(), m_secondaryFlowSockets[i]->GetLocalPort()});
+        }
+        PrintFlowStatistics(m_latencyData, flows);
+    }
+    if (m_ecnCodepoint != EcnCodepoint::NotEct)
+    {
+        PrintEcnStatistics(m_latencyData);
+    }
+
+    if (m_loadFlow && m_loadFlow->IsStarted())
+    {
+        m_loadFlow->PrintStatistics(m_latencyData, static_cast<size_t>(*m_loadInterface));
+    }
+    else if (m_loadInterface)
+    {
+        Log<LogLevel::Output>("\nThe load flow did not start, the latency under load is not available\n");
+    }
+}
+
+void StreamClient::PrintScenarioResults(const std::vector<unsigned long>& deadlines)
 {
-    PrintLatencyStatistics(m_latencyData);
+    for (auto& result : m_scenarioResults)
+    {
+        std::wcout << L"\n=== PHASE " << result.m_name << L" ===\n";
+
+        auto sent = [](const auto& stat) { return stat.m_sendTimestamp >= 0; };
+        if (std::ranges::none_of(result.m_data.m_primary.m_latencies, sent) &&
+            std::ranges::none_of(result.m_data.m_secondary.m_latencies, sent))
+        {
+            std::cout << "No datagram was sent: the interfaces of this phase were not ready\n";
+            continue;
+        }
+        PrintLatencyStatistics(result.m_data, deadlines);
+        if (m_ecnCodepoint != EcnCodepoint::NotEct)
+        {
+            PrintEcnStatistics(result.m_data);
+        }
+    }
+}
+
+void StreamClient::PrintBandwidthEstimates() const
+{
+    if (m_primaryBandwidthEstimate)
+    {
+        PrintBandwidthEstimate("PRIMARY", *m_primaryBandwidthEstimate);
+    }
+    if (m_secondaryBandwidthEstimate)
+    {
+        PrintBandwidthEstimate("SECONDARY", *m_secondaryBandwidthEstimate);
+    }
+}
+
+void StreamClient::PrintCapacitySearchResults() const
+{
+    if (m_primaryCapacitySearch)
+    {
+        PrintCapacitySearch("PRIMARY", *m_primaryCapacitySearch);
+    }
+    if (m_secondaryCapacitySearch)
+    {
+        PrintCapacitySearch("SECONDARY", *m_secondaryCapacitySearch);
+    }
 }
 
 void StreamClient::DumpLatencyData(std::ofstream& file)
@@ -210,9 +955,12 @@ void StreamClient::DumpLatencyData(std::ofstream& file)
 
 void StreamClient::TimerCallback() noexcept
 {
-    for (auto i = 0; i < m_grouping && m_sequenceNumber < m_finalSequenceNumber; ++i)
+    SendDatagrams((std::min)(m_grouping, m_finalSequenceNumber - m_sequenceNumber));
+
+    if (m_loadInterface && !m_loadPhaseStarted && m_sequenceNumber >= m_finalSequenceNumber / 2)
     {
-        SendDatagrams();
+        m_loadPhaseStarted = true;
+        StartLoadFlow();
     }
 
     // Stop when the last sequence number is reached
@@ -220,65 +968,259 @@ void StreamClient::TimerCallback() noexcept
     {
         Log<LogLevel::Info>("Final sequence number sent, canceling timer callback\n");
         FAIL_FAST_IF_MSG(m_sequenceNumber > m_finalSequenceNumber, "Exceeded the expected number of packets sent");
-        Stop();
+        if (m_probing)
+        {
+            // The search waits for the trial datagrams in flight and starts the next trial
+            m_threadpoolTimer->Stop();
+            m_trialSentEvent.SetEvent();
+        }
+        else
+        {
+            Stop();
+        }
     }
 }
 
-void StreamClient::SendDatagrams() noexcept
+void StreamClient::CreateLoadFlow() noexcept
 {
-    m_primaryState.SendDatagram(m_sequenceNumber, [this](const auto& r) { SendCompletion(Interface::Primary, r); });
+    const auto& state = *m_loadInterface == Interface::Primary ? m_primaryState : m_secondaryState;
+    try
+    {
+        m_loadFlow = std::make_unique<LoadFlow>(m_targetAddress, state.GetInterfaceIndex(), m_loadBitRate);
+    }
+    catch (...)
+    {
+        LOG_CAUGHT_EXCEPTION_MSG("Failed to create the load flow");
+        m_loadFlow.reset();
+    }
+}
 
-    if (m_secondaryState.m_adapterStatus == MeasuredSocket::AdapterStatus::Ready)
+void StreamClient::StartLoadFlow() noexcept
+{
+    // The load flow is created when its interface becomes ready, before its status is set: a ready interface
+    // guarantees the load flow is visible to the send timer
+    const auto* interfaceName = *m_loadInterface == Interface::Primary ? "primary" : "secondary";
+    const auto& state = *m_loadInterface == Interface::Primary ? m_primaryState : m_secondaryState;
+    if (state.m_adapterStatus != MeasuredSocket::AdapterStatus::Ready || !m_loadFlow)
     {
-        m_secondaryState.SendDatagram(
-            m_sequenceNumber, [this](const auto& r) { SendCompletion(Interface::Secondary, r); });
+        Log<LogLevel::Output>("The %s interface is not ready, the load flow is not started\n", interfaceName);
+        return;
     }
 
-    m_sequenceNumber += 1;
+    m_loadFlow->Start();
+    Log<LogLevel::Output>("Half the datagrams are sent, loading the %s interface\n", interfaceName);
 }
 
-void StreamClient::SendCompletion(const Interface interface, const MeasuredSocket::SendResult& sendState) noexcept
+void StreamClient::AutotuneSockets() noexcept
 {
-    auto& stat = m_latencyData.m_latencies[static_cast<size_t>(sendState.m_sequenceNumber)];
+    // The host counter is shared by all the UDP sockets: any increase is a hint the receive queues are too short
+    bool hostReceiveDropsIncreased = false;
+    try
+    {
+        const auto hostReceiveErrors = GetHostReceiveErrors();
+        // The counters wrap around: any change is an increase
+        hostReceiveDropsIncreased = hostReceiveErrors != m_autotuneHostReceiveErrors;
+        m_autotuneHostReceiveErrors = hostReceiveErrors;
+    }
+    catch (...)
+    {
+        LOG_CAUGHT_EXCEPTION_MSG("Failed to read the host receive drop counter");
+    }
 
-    if (interface == Interface::Primary)
+    // The flows share the bitrate
+    const auto flowBitRate = m_bitRate / static_cast<unsigned long>(m_flowCount);
+    m_primaryState.Autotune(flowBitRate, hostReceiveDropsIncreased);
+    m_secondaryState.Autotune(flowBitRate, hostReceiveDropsIncreased);
+    for (auto* flowSockets : {&m_primaryFlowSockets, &m_secondaryFlowSockets})
     {
-        stat.m_primarySendTimestamp = sendState.m_sendTimestamp;
+        for (auto& flowSocket : *flowSockets)
+        {
+            flowSocket->Autotune(flowBitRate, hostReceiveDropsIncreased);
+        }
     }
-    else
+}
+
+void StreamClient::SendDatagrams(long long count) noexcept
+{
+    if (m_sendOnPrimary && m_primaryState.m_adapterStatus == MeasuredSocket::AdapterStatus::Ready)
+    {
+        m_primaryOutstandingDatagrams += SendOnInterface(Interface::Primary, count);
+    }
+
+    if (m_sendOnSecondary && m_secondaryState.m_adapterStatus == MeasuredSocket::AdapterStatus::Ready)
     {
-        stat.m_secondarySendTimestamp = sendState.m_sendTimestamp;
+        m_secondaryOutstandingDatagrams += SendOnInterface(Interface::Secondary, count);
     }
+
+    m_sequenceNumber += count;
 }
 
-void StreamClient::ReceiveCompletion(const Interface interface, const MeasuredSocket::ReceiveResult& result) noexcept
+long long StreamClient::SendOnInterface(const Interface interface, long long count) noexcept
 {
-    if (result.m_sequenceNumber < 0 || result.m_sequenceNumber >= m_finalSequenceNumber)
+    const auto sendCompletion = [this, interface](const auto& r) { SendCompletion(interface, r); };
+    if (m_flowCount <= 1)
     {
-        Log<LogLevel::Debug>("Received a corrupt datagrams, sequence number: %lld\n", result.m_sequenceNumber);
-        if (interface == Interface::Primary)
+        return GetSocket(interface, m_sequenceNumber).SendDatagrams(m_sequenceNumber, count, sendCompletion);
+    }
+
+    // The flows take turns datagram by datagram, so that they are measured over the same period
+    long long sentDatagrams = 0;
+    for (auto sequenceNumber = m_sequenceNumber; sequenceNumber < m_sequenceNumber + count; ++sequenceNumber)
+    {
+        sentDatagrams += GetSocket(interface, sequenceNumber).SendDatagrams(sequenceNumber, 1, sendCompletion);
+    }
+    return sentDatagrams;
+}
+
+PathLatencyData& StreamClient::GetPathLatencyData(const Interface interface) noexcept
+{
+    return interface == Interface::Primary ? m_latencyData.m_primary : m_latencyData.m_secondary;
+}
+
+std::vector<std::unique_ptr<MeasuredSocket>>& StreamClient::GetFlowSockets(const Interface interface) noexcept
+{
+    return interface == Interface::Primary ? m_primaryFlowSockets : m_secondaryFlowSockets;
+}
+
+MeasuredSocket& StreamClient::GetSocket(const Interface interface, long long sequenceNumber) noexcept
+{
+    auto& state = interface == Interface::Primary ? m_primaryState : m_secondaryState;
+    if (m_flowCount <= 1)
+    {
+        return state;
+    }
+
+    const auto flow = static_cast<size_t>(sequenceNumber % static_cast<long long>(m_flowCount));
+    if (flow == 0)
+    {
+        return state;
+    }
+    return *(interface == Interface::Primary ? m_primaryFlowSockets : m_secondaryFlowSockets)[flow - 1];
+}
+
+std::atomic<long long>& StreamClient::GetOutstandingDatagrams(const Interface interface) noexcept
+{
+    return interface == Interface::Primary ? m_primaryOutstandingDatagrams : m_secondaryOutstandingDatagrams;
+}
+
+StreamClient::ReceiveCounters& StreamClient::GetReceiveCounters(const Interface interface) noexcept
+{
+    return interface == Interface::Primary ? m_primaryReceiveCounters : m_secondaryReceiveCounters;
+}
+
+StreamClient::HostReceiveErrors StreamClient::GetHostReceiveErrors() const
+{
+    HostReceiveErrors errors{};
+    for (const auto family : {AF_INET, AF_INET6})
+    {
+        const auto usesFamily =
+            m_targetAddress.family() == family ||
+            std::any_of(m_flowTargetAddresses.begin(), m_flowTargetAddresses.end(), [family](const auto& address) {
+                return address.family() == family;
+            });
+        if (usesFamily)
         {
-            m_latencyData.m_primaryCorruptDatagrams += 1;
+            errors[family == AF_INET6 ? 1 : 0] = GetHostUdpReceiveErrors(family);
         }
-        else
+    }
+    return errors;
+}
+
+long long StreamClient::CountHostReceiveDropsSince(const HostReceiveErrors& errorsAtStart) const
+{
+    // The differences are taken in 32 bits, so that they stay right when a counter wrapped around in between
+    const auto errors = GetHostReceiveErrors();
+    long long drops = 0;
+    for (size_t i = 0; i < errors.size(); ++i)
+    {
+        drops += static_cast<long long>(static_cast<DWORD>(errors[i] - errorsAtStart[i]));
+    }
+    return drops;
+}
+
+PathLatencyMeasure& StreamClient::GetLatencyMeasure(const Interface interface, long long sequenceNumber) noexcept
+{
+    auto& flowLatencies = interface == Interface::Primary ? m_primaryFlowLatencies : m_secondaryFlowLatencies;
+    if (flowLatencies.empty())
+    {
+        return GetPathLatencyData(interface).m_latencies[static_cast<size_t>(sequenceNumber)];
+    }
+
+    const auto flowCount = static_cast<long long>(m_flowCount);
+    return flowLatencies[static_cast<size_t>(sequenceNumber % flowCount)][static_cast<size_t>(sequenceNumber / flowCount)];
+}
+
+bool StreamClient::IsRecordedSequenceNumber(const Interface interface, long long sequenceNumber) noexcept
+{
+    const auto& flowLatencies = interface == Interface::Primary ? m_primaryFlowLatencies : m_secondaryFlowLatencies;
+    const auto recordedDatagrams =
+        flowLatencies.empty() ? static_cast<long long>(GetPathLatencyData(interface).m_latencies.size()) : m_finalSequenceNumber;
+    return sequenceNumber >= 0 && sequenceNumber < recordedDatagrams;
+}
+
+void StreamClient::JoinFlowLatencies() noexcept
+{
+    if (m_primaryFlowLatencies.empty())
+    {
+        return;
+    }
+
+    for (const auto interface : {Interface::Primary, Interface::Secondary})
+    {
+        auto& latencies = GetPathLatencyData(interface).m_latencies;
+        latencies.resize(static_cast<size_t>(m_finalSequenceNumber));
+        for (long long sequenceNumber = 0; sequenceNumber < m_finalSequenceNumber; ++sequenceNumber)
         {
-            m_latencyData.m_secondaryCorruptDatagrams += 1;
+            latencies[static_cast<size_t>(sequenceNumber)] = GetLatencyMeasure(interface, sequenceNumber);
         }
+    }
+    m_primaryFlowLatencies.clear();
+    m_secondaryFlowLatencies.clear();
+}
+
+void StreamClient::SendCompletion(const Interface interface, const MeasuredSocket::SendResult& sendState) noexcept
+{
+    // The only writer of the send timestamp: the receive completion of the same datagram may run concurrently
+    GetLatencyMeasure(interface, sendState.m_sequenceNumber).m_sendTimestamp = sendState.m_sendTimestamp;
+}
+
+void StreamClient::ReceiveCompletion(const Interface interface, const MeasuredSocket::ReceiveResult& result) noexcept
+{
+    if (!IsRecordedSequenceNumber(interface, result.m_sequenceNumber))
+    {
+        Log<LogLevel::Debug>("Received a corrupt datagrams, sequence number: %lld\n", result.m_sequenceNumber);
+        GetReceiveCounters(interface).m_corruptDatagrams += 1;
+        return;
+    }
+
+    auto& stat = GetLatencyMeasure(interface, result.m_sequenceNumber);
+    if (stat.m_receiveTimestamp >= 0)
+    {
+        Log<LogLevel::Debug>("Received a duplicate datagram, sequence number: %lld\n", result.m_sequenceNumber);
         return;
     }
 
-    auto& stat = m_latencyData.m_latencies[static_cast<size_t>(result.m_sequenceNumber)];
-    if (interface == Interface::Primary)
+    if (result.m_receiveTimestamp > m_drainDeadline)
     {
-        stat.m_primarySendTimestamp = result.m_sendTimestamp;
-        stat.m_primaryEchoTimestamp = result.m_echoTimestamp;
-        stat.m_primaryReceiveTimestamp = result.m_receiveTimestamp;
+        GetReceiveCounters(interface).m_lateDatagrams += 1;
     }
     else
     {
-        stat.m_secondarySendTimestamp = result.m_sendTimestamp;
-        stat.m_secondaryEchoTimestamp = result.m_echoTimestamp;
-        stat.m_secondaryReceiveTimestamp = result.m_receiveTimestamp;
+        stat.m_echoTimestamp = result.m_echoTimestamp;
+        stat.m_echoEcnCodepoint = result.m_echoEcnCodepoint;
+        stat.m_receiveTimestamp = result.m_receiveTimestamp;
+
+        if (m_frameTracker.IsEnabled())
+        {
+            m_frameTracker.OnReceived(static_cast<size_t>(interface), result.m_sequenceNumber, result.m_receiveTimestamp);
+        }
+    }
+
+    // The last outstanding datagram ends the drain early
+    if (result.m_sequenceNumber >= m_firstOutstandingSequenceNumber && --GetOutstandingDatagrams(interface) <= 0 && m_draining &&
+        IsDrained())
+    {
+        m_drainedEvent.SetEvent();
     }
 }
 
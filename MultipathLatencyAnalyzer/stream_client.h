@@ -9,14 +9,26 @@
 
 #include <wil/resource.h>
 
+#include <array>
 #include <atomic>
+#include <climits>
 #include <fstream>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
 #include <vector>
 
+#include "bandwidth_probe.h"
+#include "capacity_search.h"
+#include "flow_statistics.h"
+#include "frame_tracker.h"
 #include "latencyStatistics.h"
+#include "load_flow.h"
 #include "measuredSocket.h"
+#include "scenario.h"
 #include "threadpool_timer.h"
+#include "traffic_class.h"
 
 using namespace winrt;
 using namespace Windows::Networking::Connectivity;
@@ -26,14 +38,67 @@ namespace multipath {
 class StreamClient
 {
 public:
-    StreamClient(ctl::ctSockaddr targetAddress, unsigned long receiveBufferCount, HANDLE completeEvent);
+    enum class Interface
+    {
+        Primary,
+        Secondary
+    };
+
+    StreamClient(ctl::ctSockaddr targetAddress, unsigned long receiveBufferCount, bool udpOffload, bool autotune, HANDLE completeEvent);
+
+    // Check the connectivity to all the addresses at the same time, on the default interface, as the addresses a name
+    // resolves to are raced by happy eyeballs. Returns the handshake round-trip time of each address, in nanoseconds,
+    // or -1 when the address could not be reached.
+    static std::vector<long long> ProbeTargetAddresses(const std::vector<ctl::ctSockaddr>& targetAddresses);
 
     void RequestSecondaryWlanConnection();
 
-    void Start(unsigned long bitRate, unsigned long grouping, unsigned long duration);
+    // Report the completion of each group of datagrams sent together, as an application frame
+    void EnableFrameMetrics() noexcept;
+
+    // Saturate an interface with a bulk flow during the second half of the run, to compare the latency of the two
+    // halves (see LoadFlow)
+    void EnableLoadFlow(Interface interface, unsigned long bitRate) noexcept;
+
+    // Send the datagrams on one socket per traffic class on each interface, in turn, and report the statistics of
+    // each class (see PrintTrafficClassStatistics). Must be called before Start.
+    void EnableTrafficClasses(const std::vector<TrafficClass>& classes);
+
+    // Send the datagrams on flowCount sockets on each interface, in turn: each flow has its own source port, hence its
+    // own 5-tuple for the load balancers along the path. Reports the statistics of each flow (see PrintFlowStatistics).
+    // Must be called before Start, cannot be combined with the traffic classes.
+    void EnableFlows(size_t flowCount);
+
+    // Measure other servers at the same time as the target address, one flow per target: the targets share the send
+    // timer, the bitrate and the threadpool, and the statistics of each target are reported as those of a flow.
+    // Must be called before Start, cannot be combined with the traffic classes or the flows.
+    void EnableTargets(const std::vector<ctl::ctSockaddr>& targetAddresses);
+
+    // Mark the datagrams as ECN-capable and report the Congestion Experienced marks the server received (see
+    // PrintEcnStatistics). Must be called before Start.
+    void EnableEcn(EcnCodepoint ecnCodepoint) noexcept;
+
+    void Start(
+        unsigned long bitRate, unsigned long grouping, unsigned long duration, TimerOverrunPolicy overrunPolicy, PredictorModel predictorModel);
     void Stop() noexcept;
 
-    void PrintStatistics();
+    // Search the highest bitrate each interface sustains within the loss and latency budgets, in back to back trials
+    // on the same sockets. The client is stopped when the search ends.
+    void SearchCapacity(
+        const CapacitySearchSettings& settings, unsigned long grouping, TimerOverrunPolicy overrunPolicy, PredictorModel predictorModel);
+
+    void PrintStatistics(const std::vector<unsigned long>& deadlines);
+    void PrintCapacitySearchResults() const;
+
+    // Estimate the bottleneck capacity and the available bandwidth of each interface from the dispersion of packet
+    // pairs and packet trains (see BandwidthProbeSettings). The client is stopped when the estimation ends.
+    void ProbeBandwidth(const BandwidthProbeSettings& settings, PredictorModel predictorModel);
+    void PrintBandwidthEstimates() const;
+
+    // Run the phases one after the other on the same sockets, each with its own statistics. The client is stopped
+    // when the last phase ends.
+    void RunScenario(const std::vector<ScenarioPhase>& phases, PredictorModel predictorModel);
+    void PrintScenarioResults(const std::vector<unsigned long>& deadlines);
     void DumpLatencyData(std::ofstream& file);
 
     // Not copyable or movable
@@ -45,34 +110,121 @@ public:
     ~StreamClient() = default;
 
 private:
-    enum class Interface
-    {
-        Primary,
-        Secondary
-    };
-
     NetworkInformation::NetworkStatusChanged_revoker m_networkInformationEventRevoker{};
     // The client must keep this handle open to keep the secondary STA port active
     wil::unique_wlan_handle m_wlanHandle;
 
+    // Setup the interfaces and check their connectivity, sending starts as soon as either one is ready
+    void Connect(PredictorModel predictorModel);
     void SetupSecondaryInterface();
 
+    // Setup the sockets of the traffic classes or of the flows after the first one, on the interface of the path
+    // socket, and check the connectivity of the traffic classes
+    void SetupFlowSockets(const Interface interface);
+    void CancelPath(const Interface interface) noexcept;
+
+    // Start receiving on a path whose connectivity was confirmed, and start sending if it is the first ready path
+    void StartPath(const Interface interface) noexcept;
+
+    // Send on the selected interfaces at the given bitrate for duration seconds, then wait for the datagrams in flight
+    void SendForDuration(unsigned long bitRate, unsigned long duration);
+
+    // Send on one interface at the given bitrate, then wait for the datagrams in flight
+    CapacityTrial RunCapacityTrial(CapacitySearch& search, const Interface interface, unsigned long bitRate, unsigned long duration);
+    BandwidthEstimate ProbePathBandwidth(const Interface interface, const BandwidthProbeSettings& settings);
+
+    // Send count datagrams on one interface, one every gap nanoseconds or back to back if gap is 0
+    void SendPacedDatagrams(const Interface interface, long long count, long long gap) noexcept;
+
+    // The next drain only waits for the datagrams sent after this call
+    void ResetOutstandingDatagrams() noexcept;
+
     void TimerCallback() noexcept;
+    void CreateLoadFlow() noexcept;
+    void StartLoadFlow() noexcept;
+    void AutotuneSockets() noexcept;
 
-    void SendDatagrams() noexcept;
+    void SendDatagrams(long long count) noexcept;
+    long long SendOnInterface(const Interface interface, long long count) noexcept;
     void SendCompletion(const Interface interface, const MeasuredSocket::SendResult& sendState) noexcept;
     void ReceiveCompletion(const Interface interface, const MeasuredSocket::ReceiveResult& result) noexcept;
 
+    PathLatencyData& GetPathLatencyData(const Interface interface) noexcept;
+
+    // The entry of a datagram, in the storage of the socket that sends it (see m_primaryFlowLatencies)
+    PathLatencyMeasure& GetLatencyMeasure(const Interface interface, long long sequenceNumber) noexcept;
+    [[nodiscard]] bool IsRecordedSequenceNumber(const Interface interface, long long sequenceNumber) noexcept;
+
+    // Copy the storage of each flow into the latency data, by sequence number. The sockets must be closed.
+    void JoinFlowLatencies() noexcept;
+
+    // The socket of the traffic class or of the flow of the datagram, the path socket with a single flow
+    MeasuredSocket& GetSocket(const Interface interface, long long sequenceNumber) noexcept;
+    std::vector<std::unique_ptr<MeasuredSocket>>& GetFlowSockets(const Interface interface) noexcept;
+
+    // Copy the send timer counters, and the socket settings, receive counters and prediction errors of each interface
+    void CaptureTimerStatistics(LatencyData& data) const noexcept;
+    void CaptureSocketStatistics(LatencyData& data) noexcept;
+    long long GetSendRingDrops(const Interface interface) noexcept;
+    std::atomic<long long>& GetOutstandingDatagrams(const Interface interface) noexcept;
+
+    // The sockets of the traffic classes, the flows or the targets of an interface complete concurrently, each under
+    // its own lock: the counters they share are atomic, copied to the latency data by CaptureSocketStatistics
+    struct alignas(c_cacheLineSize) ReceiveCounters
+    {
+        std::atomic<long long> m_corruptDatagrams{0};
+        std::atomic<long long> m_lateDatagrams{0};
+    };
+    ReceiveCounters& GetReceiveCounters(const Interface interface) noexcept;
+
+    // The host UDP receive error counters of IPv4 and IPv6, read only for the families of the targets (0 otherwise):
+    // the targets may mix both families
+    using HostReceiveErrors = std::array<DWORD, 2>;
+    [[nodiscard]] HostReceiveErrors GetHostReceiveErrors() const;
+    [[nodiscard]] long long CountHostReceiveDropsSince(const HostReceiveErrors& errorsAtStart) const;
+
+    // Wait for the datagrams still in flight at the end of the run, see Stop
+    void DrainOutstandingDatagrams() noexcept;
+    [[nodiscard]] bool IsDrained() const noexcept;
+
     ctl::ctSockaddr m_targetAddress{};
 
     MeasuredSocket m_primaryState{};
     MeasuredSocket m_secondaryState{};
 
+    // The datagram with sequence number s is sent on the flow s % m_flowCount, one flow per traffic class when they are
+    // enabled. The first flow uses the path sockets above, each other flow has its own socket on each interface.
+    size_t m_flowCount = 1;
+    std::vector<TrafficClass> m_trafficClasses;
+    // The server of each flow after the first one, when the flows have different targets
+    std::vector<ctl::ctSockaddr> m_flowTargetAddresses;
+    std::vector<std::unique_ptr<MeasuredSocket>> m_primaryFlowSockets;
+    std::vector<std::unique_ptr<MeasuredSocket>> m_secondaryFlowSockets;
+
+    // With several flows, each flow records its datagrams in its own storage, indexed by sequence number / m_flowCount:
+    // the completions of the sockets of an interface never write to the same cache line. Joined when the run stops.
+    using FlowLatencies = std::vector<PathLatencyMeasure, CacheAlignedAllocator<PathLatencyMeasure>>;
+    std::vector<FlowLatencies> m_primaryFlowLatencies;
+    std::vector<FlowLatencies> m_secondaryFlowLatencies;
+
+    EcnCodepoint m_ecnCodepoint = EcnCodepoint::NotEct;
+
     // The number of datagrams to send on each timer callback
     long long m_grouping = 0;
     unsigned long m_receiveBufferCount = 1;
+    bool m_udpOffload = false;
+
+    // Grow the socket buffers and the posted receives as the run goes, see MeasuredSocket::Autotune. The autotuner
+    // runs every second on its own timer, and reads the bitrate while a capacity search or a scenario changes it.
+    bool m_autotune = false;
+    std::atomic<unsigned long> m_bitRate{0};
+    HostReceiveErrors m_autotuneHostReceiveErrors{};
 
     std::unique_ptr<ThreadpoolTimer> m_threadpoolTimer{};
+    std::unique_ptr<ThreadpoolTimer> m_autotuneTimer{};
+    long long m_tickInterval = 0; // 100 nanosec
+    TimerOverrunPolicy m_overrunPolicy = TimerOverrunPolicy::Burst;
+    std::once_flag m_startSending;
 
     // Initialize to -1 as the first datagram has sequence number 0
     long long m_finalSequenceNumber = -1;
@@ -80,6 +232,49 @@ private:
 
     LatencyData m_latencyData;
 
+    // During a capacity search, a bandwidth probe or a scenario, the client sends in successive measurements rather
+    // than as soon as an interface is ready, on the selected interfaces. The datagrams sent before the current
+    // measurement are not counted as outstanding.
+    bool m_probing = false;
+    bool m_sendOnPrimary = true;
+    bool m_sendOnSecondary = true;
+    std::atomic<long long> m_firstOutstandingSequenceNumber{0};
+    wil::unique_event m_trialSentEvent{wil::EventOptions::ManualReset};
+    std::optional<CapacitySearch> m_primaryCapacitySearch;
+    std::optional<CapacitySearch> m_secondaryCapacitySearch;
+    std::optional<BandwidthEstimate> m_primaryBandwidthEstimate;
+    std::optional<BandwidthEstimate> m_secondaryBandwidthEstimate;
+
+    struct ScenarioPhaseResult
+    {
+        std::wstring m_name;
+        LatencyData m_data;
+    };
+    std::vector<ScenarioPhaseResult> m_scenarioResults;
+
+    bool m_frameMetrics = false;
+    FrameTracker m_frameTracker;
+
+    // The load flow is created when its interface becomes ready, off the send timer. It starts once half the datagrams
+    // are sent, and stops with the run.
+    std::optional<Interface> m_loadInterface;
+    unsigned long m_loadBitRate = 0;
+    bool m_loadPhaseStarted = false;
+    std::unique_ptr<LoadFlow> m_loadFlow;
+
+    // Datagrams sent but not received yet on each interface. Once the run ends, the client waits until they all
+    // come back or until the drain deadline: later datagrams are counted as late.
+    std::atomic<long long> m_primaryOutstandingDatagrams{0};
+    std::atomic<long long> m_secondaryOutstandingDatagrams{0};
+    ReceiveCounters m_primaryReceiveCounters;
+    ReceiveCounters m_secondaryReceiveCounters;
+    std::atomic<bool> m_draining{false};
+    std::atomic<long long> m_drainDeadline{LLONG_MAX}; // Nanosec
+    wil::unique_event m_drainedEvent{wil::EventOptions::ManualReset};
+
+    // Snapshot of the host UDP receive error counters when the run started
+    HostReceiveErrors m_hostReceiveErrorsAtStart{};
+
     HANDLE m_completeEvent = nullptr;
 };
 } // namespace multipath
\ No newline at end of file
@@ -4,15 +4,61 @@
 #include "stream_server.h"
 #include "datagram.h"
 #include "logs.h"
+#include "monotonic_clock.h"
 #include "socket_utils.h"
-#include "time_utils.h"
+
+#include <algorithm>
+#include <cstring>
 
 namespace multipath {
-StreamServer::StreamServer(ctl::ctSockaddr listenAddress) :
-    m_listenAddress{std::move(listenAddress)}, m_socket{CreateDatagramSocket()}
+StreamServer::StreamServer(ctl::ctSockaddr listenAddress, bool udpOffload, EchoMode echoMode) :
+    m_listenAddress{std::move(listenAddress)},
+    m_dualMode{m_listenAddress.family() == AF_INET6 && m_listenAddress.IsAddressAny()},
+    m_echoMode{echoMode}
 {
-    constexpr int defaultSocketReceiveBufferSize = 1048576; // 1MB socket receive buffer
-    SetSocketReceiveBufferSize(m_socket.get(), defaultSocketReceiveBufferSize);
+    if (m_dualMode)
+    {
+        try
+        {
+            m_socket.reset(CreateDatagramSocket(AF_INET6));
+            SetSocketDualMode(m_socket.get());
+        }
+        catch (...)
+        {
+            // IPv6 may be disabled on the host: serve the IPv4 clients, as before dual-mode sockets were used
+            LOG_CAUGHT_EXCEPTION_MSG("Failed to create a dual-mode socket");
+            Log<LogLevel::Output>("IPv6 is not available, only the IPv4 clients are served\n");
+            m_socket.reset();
+            const auto port = m_listenAddress.port();
+            m_listenAddress = ctl::ctSockaddr(AF_INET, ctl::ctSockaddr::AddressType::Any);
+            m_listenAddress.SetPort(port);
+            m_dualMode = false;
+        }
+    }
+    if (!m_socket)
+    {
+        m_socket.reset(CreateDatagramSocket(m_listenAddress.family()));
+    }
+    SetSocketReceiveBufferSize(m_socket.get(), m_socketReceiveBufferSize);
+    m_wsaRecvMsg = GetWsaRecvMsgFunction(m_socket.get());
+
+    if (udpOffload)
+    {
+        if (TrySetSocketReceiveMaxCoalescedSize(m_socket.get(), c_maxCoalescedReceiveSize))
+        {
+            m_receiveBufferSize = c_maxCoalescedReceiveSize;
+        }
+
+        Log<LogLevel::Info>("UDP receive offload is %s\n", m_receiveBufferSize == c_maxCoalescedReceiveSize ? "enabled" : "not supported");
+    }
+
+    // Report the ECN field of each datagram in its echo, to account for the congestion marks on the way to the server
+    // of a dual-mode socket, the IPv4 datagrams report it with the IPv4 option
+    if (!TrySetSocketReceiveEcn(m_socket.get(), m_listenAddress.family()) ||
+        (m_dualMode && !TrySetSocketReceiveEcn(m_socket.get(), AF_INET)))
+    {
+        Log<LogLevel::Info>("Reading the ECN field of the received datagrams is not supported\n");
+    }
 
     const auto error = bind(m_socket.get(), m_listenAddress.sockaddr(), m_listenAddress.length());
     if (SOCKET_ERROR == error)
@@ -25,37 +71,102 @@ StreamServer::StreamServer(ctl::ctSockaddr listenAddress) :
 
 void StreamServer::Start(unsigned long receiveBufferCount)
 {
+    m_hostReceiveErrorsAtStart[GetFamilyIndex(m_listenAddress.family())] = GetHostUdpReceiveErrors(m_listenAddress.family());
+    if (m_dualMode)
+    {
+        m_hostReceiveErrorsAtStart[GetFamilyIndex(AF_INET)] = GetHostUdpReceiveErrors(AF_INET);
+    }
+
     // allocate our receive contexts
     m_receiveContexts.resize(receiveBufferCount);
 
     // post a receive for each buffer
     for (auto& receiveContext : m_receiveContexts)
     {
+        receiveContext.m_buffer.resize(m_receiveBufferSize);
         InitiateReceive(receiveContext);
     }
 }
 
+long long StreamServer::GetHostReceiveDrops(short family) const
+{
+    return CountHostUdpReceiveErrorsSince(family, m_hostReceiveErrorsAtStart[GetFamilyIndex(family)]);
+}
+
+long long StreamServer::GetHostReceiveDrops() const
+{
+    auto hostReceiveDrops = GetHostReceiveDrops(m_listenAddress.family());
+    if (m_dualMode)
+    {
+        hostReceiveDrops += GetHostReceiveDrops(AF_INET);
+    }
+    return hostReceiveDrops;
+}
+
+long long StreamServer::GetEchoedDatagrams(short family) const noexcept
+{
+    return m_echoedDatagrams[GetFamilyIndex(family)].load(std::memory_order_relaxed);
+}
+
+void StreamServer::Autotune() noexcept
+{
+    try
+    {
+        const auto hostReceiveDrops = GetHostReceiveDrops();
+        if (hostReceiveDrops <= m_tunedHostReceiveDrops)
+        {
+            return;
+        }
+        m_tunedHostReceiveDrops = hostReceiveDrops;
+
+        if (m_socketReceiveBufferSize >= c_maxSocketReceiveBufferSize && m_receiveContexts.size() >= c_maxReceiveDepth)
+        {
+            return;
+        }
+
+        const auto socketReceiveBufferSize = (std::min)(m_socketReceiveBufferSize * 2, c_maxSocketReceiveBufferSize);
+        SetSocketReceiveBufferSize(m_socket.get(), socketReceiveBufferSize);
+        m_socketReceiveBufferSize = socketReceiveBufferSize;
+
+        // Only this thread changes the deque, the completions only access their own context
+        const auto receiveDepth = (std::min)(m_receiveContexts.size() * 2, c_maxReceiveDepth);
+        while (m_receiveContexts.size() < receiveDepth)
+        {
+            auto& receiveContext = m_receiveContexts.emplace_back();
+            receiveContext.m_buffer.resize(m_receiveBufferSize);
+            InitiateReceive(receiveContext);
+        }
+
+        Log<LogLevel::Output>(
+            "Host receive drops detected: socket receive buffer set to %d kB, %zu receives posted\n",
+            m_socketReceiveBufferSize / 1024,
+            receiveDepth);
+    }
+    catch (...)
+    {
+        // The server keeps echoing with its current settings
+        LOG_CAUGHT_EXCEPTION_MSG("Failed to autotune the server socket");
+    }
+}
+
 void StreamServer::InitiateReceive(ReceiveContext& receiveContext)
 {
-    receiveContext.m_remoteAddressLen = receiveContext.m_remoteAddress.length();
+    receiveContext.m_wsabuf.buf = receiveContext.m_buffer.data();
+    receiveContext.m_wsabuf.len = static_cast<ULONG>(receiveContext.m_buffer.size());
 
-    WSABUF wsabuf;
-    wsabuf.buf = receiveContext.m_buffer.data();
-    wsabuf.len = static_cast<ULONG>(receiveContext.m_buffer.size());
+    // WSARecvMsg reports the size of the datagrams coalesced by receive offload in a control message
+    receiveContext.m_message = {};
+    receiveContext.m_message.name = receiveContext.m_remoteAddress.sockaddr();
+    receiveContext.m_message.namelen = receiveContext.m_remoteAddress.length();
+    receiveContext.m_message.lpBuffers = &receiveContext.m_wsabuf;
+    receiveContext.m_message.dwBufferCount = 1;
+    receiveContext.m_message.Control.buf = receiveContext.m_controlBuffer.data();
+    receiveContext.m_message.Control.len = static_cast<ULONG>(receiveContext.m_controlBuffer.size());
 
     OVERLAPPED* ov = m_threadpoolIo->new_request(
         [this, &receiveContext](OVERLAPPED* ov) noexcept { CompleteReceive(receiveContext, ov); });
 
-    const auto error = WSARecvFrom(
-        m_socket.get(),
-        &wsabuf,
-        1,
-        nullptr,
-        &receiveContext.m_receiveFlags,
-        receiveContext.m_remoteAddress.sockaddr(),
-        &receiveContext.m_remoteAddressLen,
-        ov,
-        nullptr);
+    const auto error = m_wsaRecvMsg(m_socket.get(), &receiveContext.m_message, nullptr, ov, nullptr);
 
     if (SOCKET_ERROR == error)
     {
@@ -72,23 +183,79 @@ void StreamServer::InitiateReceive(ReceiveContext& receiveContext)
 void StreamServer::CompleteReceive(ReceiveContext& receiveContext, OVERLAPPED* ov) noexcept
 {
     DWORD bytesReceived = 0;
-    if (WSAGetOverlappedResult(m_socket.get(), ov, &bytesReceived, false, &receiveContext.m_receiveFlags))
+    DWORD flags = 0;
+    if (WSAGetOverlappedResult(m_socket.get(), ov, &bytesReceived, false, &flags))
     {
-        auto& header = *reinterpret_cast<DatagramHeader*>(receiveContext.m_buffer.data());
+        // Update the echo timestamp of each datagram, they may have been coalesced by receive offload
+        const auto echoTimestamp = SnapMonotonicNanoSec();
+        const auto coalescedDatagramSize = GetCoalescedDatagramSize(receiveContext.m_message);
+
+        // Receive offload only coalesces datagrams with the same ECN field
+        const auto ecnCodepoint = GetReceivedEcnCodepoint(receiveContext.m_message);
+
+        // The datagrams of a load flow only fill the queues towards the server. Receive offload only coalesces
+        // datagrams of the same flow, checking the first one is enough.
+        if (bytesReceived >= c_datagramMinimumHeaderLength &&
+            ParseDatagramHeader(receiveContext.m_buffer.data()).m_sequenceNumber == c_loadSequenceNumber)
+        {
+            InitiateReceive(receiveContext);
+            return;
+        }
+
+        // The clients of a dual-mode socket reaching it over IPv4 have an IPv4-mapped address
+        const auto& remoteAddress = receiveContext.m_remoteAddress;
+        const short remoteFamily =
+            remoteAddress.family() == AF_INET6 && IN6_IS_ADDR_V4MAPPED(remoteAddress.in6_addr()) ? AF_INET : remoteAddress.family();
+        long long echoedDatagrams = 0;
 
-        // Update the echo timestamp
+        // Truncated echoes are packed at the start of the buffer, in place: each header moves at or before its offset
+        const auto truncate = m_echoMode == EchoMode::Header;
+        size_t echoLength = 0;
 
-        header.m_echoTimestamp = SnapQpcInMicroSec();
-        Log<LogLevel::All>("Echoing sequence number %lld\n", header.m_sequenceNumber);
+        ForEachCoalescedDatagram(
+            std::span{receiveContext.m_buffer.data(), bytesReceived}, coalescedDatagramSize, [&](std::span<char> datagram) {
+                if (ValidateBufferLength(datagram.size()))
+                {
+                    echoedDatagrams += 1;
+                    auto& header = ParseDatagramHeader(datagram.data());
+                    header.m_echoTimestamp = echoTimestamp;
+                    if (HasEcnField(datagram.size()))
+                    {
+                        header.m_echoEcnCodepoint = ecnCodepoint;
+                    }
+                    Log<LogLevel::All>("Echoing sequence number %lld\n", header.m_sequenceNumber);
+                }
+
+                const auto datagramEchoLength = truncate ? (std::min)(datagram.size(), size_t{c_datagramHeaderLength}) : datagram.size();
+                if (truncate)
+                {
+                    std::memmove(receiveContext.m_buffer.data() + echoLength, datagram.data(), datagramEchoLength);
+                }
+                echoLength += datagramEchoLength;
+            });
+        m_echoedDatagrams[GetFamilyIndex(remoteFamily)].fetch_add(echoedDatagrams, std::memory_order_relaxed);
 
         // echo the data received. A synchronous send is enough.
+        // Coalesced datagrams are echoed in a single send, split again with segmentation offload.
         WSABUF wsabuf;
         wsabuf.buf = receiveContext.m_buffer.data();
-        wsabuf.len = bytesReceived;
+        wsabuf.len = static_cast<ULONG>(echoLength);
+
+        WSAMSG message{};
+        message.name = receiveContext.m_remoteAddress.sockaddr();
+        message.namelen = receiveContext.m_message.namelen;
+        message.lpBuffers = &wsabuf;
+        message.dwBufferCount = 1;
+
+        alignas(WSACMSGHDR) std::array<char, c_controlBufferSize> controlBuffer{};
+        const auto echoDatagramSize = truncate && coalescedDatagramSize != 0 ? c_datagramHeaderLength : coalescedDatagramSize;
+        if (echoDatagramSize != 0 && echoLength > echoDatagramSize)
+        {
+            SetSendMessageSizeControl(message, controlBuffer, echoDatagramSize);
+        }
 
         DWORD bytesTransferred = 0;
-        const auto error = WSASendTo(
-            m_socket.get(), &wsabuf, 1, &bytesTransferred, 0, receiveContext.m_remoteAddress.sockaddr(), receiveContext.m_remoteAddressLen, nullptr, nullptr);
+        const auto error = WSASendMsg(m_socket.get(), &message, 0, &bytesTransferred, nullptr, nullptr);
         if (SOCKET_ERROR == error)
         {
             // best effort send
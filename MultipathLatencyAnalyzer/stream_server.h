@@ -3,24 +3,52 @@
 
 #pragma once
 
+#include "echo_mode.h"
 #include "sockaddr.h"
+#include "socket_utils.h"
 #include "threadpool_io.h"
 
 #include <WinSock2.h>
+#include <mswsock.h>
 #include <wil/resource.h>
 
 #include <array>
+#include <atomic>
+#include <deque>
+#include <vector>
 
 namespace multipath {
+
 class StreamServer
 {
 public:
-    StreamServer(ctl::ctSockaddr listenAddress);
+    // udpOffload enables UDP receive offload (coalescing) and echoes coalesced datagrams with segmentation offload.
+    // The IPv6 unspecified address makes a dual-mode socket, serving the IPv4 clients as well.
+    StreamServer(ctl::ctSockaddr listenAddress, bool udpOffload, EchoMode echoMode = EchoMode::Full);
 
     ~StreamServer() noexcept = default;
 
     void Start(unsigned long receiveBufferCount);
 
+    // Whether the socket receives both IPv4 and IPv6 datagrams
+    [[nodiscard]] bool IsDualMode() const noexcept
+    {
+        return m_dualMode;
+    }
+
+    // Datagrams discarded by the host UDP receive queues since the server started (all sockets of the address family),
+    // for one address family or for all the families the server receives
+    [[nodiscard]] long long GetHostReceiveDrops(short family) const;
+    [[nodiscard]] long long GetHostReceiveDrops() const;
+
+    // Datagrams echoed since the server started to the clients of an address family, IPv4-mapped clients count as IPv4
+    [[nodiscard]] long long GetEchoedDatagrams(short family) const noexcept;
+
+    // Double the socket receive buffer and the number of posted receives if the host dropped received datagrams
+    // since the previous call. Must be called from the thread that started the server. Errors are logged: the server
+    // keeps its current settings.
+    void Autotune() noexcept;
+
     // not copyable or movable
     StreamServer(const StreamServer&) = delete;
     StreamServer& operator=(const StreamServer&) = delete;
@@ -30,23 +58,52 @@ public:
 private:
     static constexpr std::size_t c_receiveBufferSize = 1024; // 1KB receive buffer
 
+    // Size of the receive buffers when receive offload may coalesce datagrams
+    static constexpr std::size_t c_maxCoalescedReceiveSize = 65535;
+
+    // Initial size of the socket receive buffer, and the largest size the autotuner may set
+    static constexpr int c_defaultSocketReceiveBufferSize = 1048576;  // 1MB
+    static constexpr int c_maxSocketReceiveBufferSize = 64 * 1048576; // 64MB
+
+    // Largest number of receives the autotuner may keep posted
+    static constexpr std::size_t c_maxReceiveDepth = 64;
+
     struct ReceiveContext
     {
-        std::array<char, c_receiveBufferSize> m_buffer{};
+        std::vector<char> m_buffer;
+        alignas(WSACMSGHDR) std::array<char, c_controlBufferSize> m_controlBuffer{};
         ctl::ctSockaddr m_remoteAddress{};
-        int m_remoteAddressLen = 0;
-        DWORD m_receiveFlags = 0;
+        WSABUF m_wsabuf{};
+        WSAMSG m_message{};
     };
 
     void InitiateReceive(ReceiveContext& receiveContext);
 
     void CompleteReceive(ReceiveContext& receiveContext, OVERLAPPED* ov) noexcept;
 
+    // Index of the per-family counters: 0 for IPv4, 1 for IPv6
+    static size_t GetFamilyIndex(short family) noexcept
+    {
+        return family == AF_INET6 ? 1 : 0;
+    }
+
     ctl::ctSockaddr m_listenAddress;
+    bool m_dualMode = false;
+    EchoMode m_echoMode = EchoMode::Full;
 
     wil::unique_socket m_socket;
     std::unique_ptr<ctl::ctThreadIocp> m_threadpoolIo;
+    LPFN_WSARECVMSG m_wsaRecvMsg = nullptr;
+
+    std::size_t m_receiveBufferSize = c_receiveBufferSize;
+
+    std::array<DWORD, 2> m_hostReceiveErrorsAtStart{};
+    std::array<std::atomic<long long>, 2> m_echoedDatagrams{};
+
+    int m_socketReceiveBufferSize = c_defaultSocketReceiveBufferSize;
+    long long m_tunedHostReceiveDrops = 0;
 
-    std::vector<ReceiveContext> m_receiveContexts;
+    // A deque, so that growing it keeps the posted contexts in place
+    std::deque<ReceiveContext> m_receiveContexts;
 };
 } // namespace multipath
\ No newline at end of file
@@ -4,16 +4,27 @@
 #pragma once
 
 #include <Windows.h>
+#include <algorithm>
+#include <atomic>
 #include <functional>
 
 #include <wil/result.h>
 
+#include "latency_histogram.h"
 #include "time_utils.h"
 
 namespace multipath {
 
 using ThreadpoolTimerCallback = std::function<void()>;
 
+// What the timer does when a tick is already due by the time the previous callback returns
+enum class TimerOverrunPolicy
+{
+    Burst, // run the missed ticks back to back until the schedule is caught up
+    Skip,  // drop the ticks a whole period late or more, and run the latest due tick immediately
+    Spread // run the missed ticks at a faster pace until the schedule is caught up
+};
+
 class ThreadpoolTimer
 {
 public:
@@ -37,10 +48,11 @@ public:
     ThreadpoolTimer(ThreadpoolTimer&&) = delete;
     ThreadpoolTimer& operator=(ThreadpoolTimer&&) = delete;
 
-    void Schedule(unsigned long periodInHundredNanosec) noexcept
+    void Schedule(unsigned long periodInHundredNanosec, TimerOverrunPolicy overrunPolicy = TimerOverrunPolicy::Burst) noexcept
     {
         m_exiting = false;
         m_period = periodInHundredNanosec;
+        m_overrunPolicy = overrunPolicy;
         m_timerExpiration = SnapSystemTimeInHundredNs();
 
         FILETIME expiration{};
@@ -56,28 +68,101 @@ public:
         }
     }
 
+    // Stop and wait for a running callback to return, after which the timer can be scheduled again.
+    // Must not be called from the callback.
+    void StopAndWait() noexcept
+    {
+        Stop();
+        if (m_ptpTimer)
+        {
+            WaitForThreadpoolTimerCallbacks(m_ptpTimer, false);
+        }
+    }
+
+    // Ticks that ran, ticks that ran after the next one was already due, and ticks dropped by TimerOverrunPolicy::Skip
+    [[nodiscard]] long long GetTickCount() const noexcept
+    {
+        return m_tickCount;
+    }
+
+    [[nodiscard]] long long GetLateTickCount() const noexcept
+    {
+        return m_lateTickCount;
+    }
+
+    [[nodiscard]] long long GetSkippedTickCount() const noexcept
+    {
+        return m_skippedTickCount;
+    }
+
+    // Delay between the due time of each tick and the start of its callback, in nanoseconds
+    [[nodiscard]] const LatencyHistogram& GetLateness() const noexcept
+    {
+        return m_lateness;
+    }
+
+    // Restart the tick counters and the lateness histogram, while the timer is stopped
+    void ResetStatistics() noexcept
+    {
+        m_tickCount = 0;
+        m_lateTickCount = 0;
+        m_skippedTickCount = 0;
+        m_lateness.Reset();
+    }
+
 private:
+    // Missed ticks run at this many times the nominal rate with TimerOverrunPolicy::Spread
+    static constexpr long long c_spreadCatchUpRate = 2;
 
-    void ScheduleNextPeriod() noexcept
+    // Returns true if the next tick is already due and must run immediately
+    bool ScheduleNextPeriod() noexcept
     {
         // Don't schedule a next period if the callback (or someone else) called stop
         if (m_exiting)
         {
-            return;
+            return false;
         }
 
         m_timerExpiration += m_period;
-        const long long remainingTime = max(0, m_timerExpiration - SnapSystemTimeInHundredNs());
+        const auto now = SnapSystemTimeInHundredNs();
+        long long remainingTime = m_timerExpiration - now;
 
-        // We are late! Call the next callback immediately
+        // We are late!
         if (remainingTime <= 0)
         {
-            TimerCallback(nullptr, this, nullptr);
+            switch (m_overrunPolicy)
+            {
+            case TimerOverrunPolicy::Burst:
+                return true;
+
+            case TimerOverrunPolicy::Skip:
+            {
+                // A tick due now or less than a period ago is only late: it runs. Only the ticks due before it are missed.
+                const auto missedTicks = -remainingTime / static_cast<long long>(m_period);
+                m_skippedTickCount += missedTicks;
+                m_timerExpiration += missedTicks * m_period;
+                return true;
+            }
+
+            case TimerOverrunPolicy::Spread:
+                remainingTime = (std::max)(1LL, static_cast<long long>(m_period) / c_spreadCatchUpRate);
+                break;
+            }
         }
-        else
+
+        FILETIME expiration = ConvertHundredNsToRelativeFiletime(remainingTime);
+        SetThreadpoolTimer(m_ptpTimer, &expiration, 0, 0);
+        return false;
+    }
+
+    void RecordLateness() noexcept
+    {
+        const auto lateness = SnapSystemTimeInHundredNs() - m_timerExpiration;
+        m_lateness.Record(lateness * 100);
+        m_tickCount += 1;
+        if (lateness >= static_cast<long long>(m_period))
         {
-            FILETIME expiration = ConvertHundredNsToRelativeFiletime(remainingTime);
-            SetThreadpoolTimer(m_ptpTimer, &expiration, 0, 0);
+            m_lateTickCount += 1;
         }
     }
 
@@ -85,30 +170,41 @@ private:
     {
         auto* self = static_cast<ThreadpoolTimer*>(context);
 
-        if (self->m_exiting)
+        // Loop rather than recurse when ticks are already due, however long the stall was
+        do
         {
-            return;
-        }
-
-        try
-        {
-            self->m_callback();
-        }
-        catch (...)
-        {
-            // immediately break if we catch an exception
-            FAIL_FAST_MSG("exception raised in timer callback routine");
-        }
-
-        // Schedule the next period manually to ensure the callbacks run sequentially
-        self->ScheduleNextPeriod();
+            if (self->m_exiting)
+            {
+                return;
+            }
+
+            self->RecordLateness();
+
+            try
+            {
+                self->m_callback();
+            }
+            catch (...)
+            {
+                // immediately break if we catch an exception
+                FAIL_FAST_MSG("exception raised in timer callback routine");
+            }
+
+            // Schedule the next period manually to ensure the callbacks run sequentially
+        } while (self->ScheduleNextPeriod());
     }
 
     std::atomic_bool m_exiting = false;
     PTP_TIMER m_ptpTimer = nullptr;
     long long m_timerExpiration{};
     unsigned long m_period = 0;
+    TimerOverrunPolicy m_overrunPolicy = TimerOverrunPolicy::Burst;
     ThreadpoolTimerCallback m_callback{};
+
+    std::atomic<long long> m_tickCount{0};
+    std::atomic<long long> m_lateTickCount{0};
+    std::atomic<long long> m_skippedTickCount{0};
+    LatencyHistogram m_lateness;
 };
 
 } // namespace multipath
\ No newline at end of file
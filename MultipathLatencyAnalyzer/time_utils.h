@@ -15,19 +15,6 @@ inline long long SnapQpc() noexcept
     return qpc.QuadPart;
 }
 
-inline long long SnapQpcInMicroSec() noexcept
-{
-    // snap the frequency on first call; C++11 guarantees this is thread-safe
-    static const long long c_qpf = []() {
-        LARGE_INTEGER qpf;
-        QueryPerformanceFrequency(&qpf);
-        return qpf.QuadPart;
-    }();
-
-    // (qpc / qpf) is in seconds
-    return static_cast<long long>(SnapQpc() * 1'000'000LL / c_qpf);
-}
-
 // Create a negative FILETIME, which for some timer APIs indicate a 'relative' time
 // - e.g. SetThreadpoolTimer, where a negative value indicates the amount of time to wait relative to the current time
 inline FILETIME ConvertHundredNsToRelativeFiletime(long long hundredNanoseconds) noexcept
@@ -0,0 +1,111 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#include "traffic_class.h"
+
+#include <algorithm>
+#include <array>
+#include <iomanip>
+#include <iostream>
+
+namespace multipath {
+namespace {
+
+    struct ClassStatistics
+    {
+        long long m_sentDatagrams = 0;
+        std::vector<long long> m_latencies; // Nanosec
+    };
+
+    long long GetPercentile(const std::vector<long long>& sortedLatencies, double percentile) noexcept
+    {
+        if (sortedLatencies.empty())
+        {
+            return 0;
+        }
+        const auto rank = static_cast<size_t>(static_cast<double>(sortedLatencies.size()) * percentile / 100);
+        return sortedLatencies[(std::min)(sortedLatencies.size() - 1, rank)];
+    }
+
+} // namespace
+
+const char* GetTrafficClassName(TrafficClass trafficClass) noexcept
+{
+    switch (trafficClass)
+    {
+    case TrafficClass::BestEffort:
+        return "best effort";
+    case TrafficClass::Background:
+        return "background";
+    case TrafficClass::Video:
+        return "video";
+    case TrafficClass::Voice:
+        return "voice";
+    }
+    return "unknown";
+}
+
+void PrintTrafficClassStatistics(const LatencyData& data, const std::vector<TrafficClass>& classes)
+{
+    if (classes.empty())
+    {
+        return;
+    }
+
+    // For each class: the primary interface, the secondary interface and the combined interfaces
+    std::vector<std::array<ClassStatistics, 3>> statistics(classes.size());
+    auto record = [](ClassStatistics& stats, long long send, long long receive) {
+        if (send < 0)
+        {
+            return;
+        }
+        stats.m_sentDatagrams += 1;
+        if (receive >= 0)
+        {
+            stats.m_latencies.push_back(receive - send);
+        }
+    };
+
+    const auto latencies = JoinLatencyMeasures(data);
+    for (size_t i = 0; i < latencies.size(); ++i)
+    {
+        const auto& stat = latencies[i];
+        auto& classStatistics = statistics[i % classes.size()];
+        record(classStatistics[0], stat.m_primarySendTimestamp, stat.m_primaryReceiveTimestamp);
+        record(classStatistics[1], stat.m_secondarySendTimestamp, stat.m_secondaryReceiveTimestamp);
+
+        // The combined interfaces: from the first send to the first echo received, on any interface
+        auto first = [](long long a, long long b) { return a < 0 ? b : (b < 0 ? a : (std::min)(a, b)); };
+        record(
+            classStatistics[2],
+            first(stat.m_primarySendTimestamp, stat.m_secondarySendTimestamp),
+            first(stat.m_primaryReceiveTimestamp, stat.m_secondaryReceiveTimestamp));
+    }
+
+    const char* pathNames[] = {"primary interface", "secondary interface", "combined interfaces"};
+    auto percent = [](auto a, auto b) { return b > 0 ? a * 100. / b : 0.; };
+
+    std::cout << std::setprecision(2) << std::fixed;
+
+    std::cout << '\n';
+    std::cout << "--- TRAFFIC CLASSES ---\n";
+    for (size_t c = 0; c < classes.size(); ++c)
+    {
+        std::cout << '\n';
+        for (size_t path = 0; path < 3; ++path)
+        {
+            auto& stats = statistics[c][path];
+            std::ranges::sort(stats.m_latencies);
+            const auto receivedDatagrams = static_cast<long long>(stats.m_latencies.size());
+            std::cout << "Class " << GetTrafficClassName(classes[c]) << " on " << pathNames[path] << ": "
+                      << stats.m_sentDatagrams - receivedDatagrams << " / " << stats.m_sentDatagrams << " datagrams lost ("
+                      << percent(stats.m_sentDatagrams - receivedDatagrams, stats.m_sentDatagrams)
+                      << "%), latency (median / 99th / 99.9th percentile): "
+                      << ConvertNanosToMillis(GetPercentile(stats.m_latencies, 50)) << " ms / "
+                      << ConvertNanosToMillis(GetPercentile(stats.m_latencies, 99)) << " ms / "
+                      << ConvertNanosToMillis(GetPercentile(stats.m_latencies, 99.9)) << " ms\n";
+        }
+    }
+}
+
+} // namespace multipath
@@ -0,0 +1,29 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include "latencyStatistics.h"
+
+#include <vector>
+
+namespace multipath {
+
+// The Wi-Fi WMM access categories a flow can be marked with. The socket of each class is added to a qWAVE flow of
+// the matching traffic type, which sets the DSCP and the 802.1p priority (hence the WMM queue) of its datagrams.
+enum class TrafficClass
+{
+    BestEffort,
+    Background,
+    Video,
+    Voice
+};
+
+[[nodiscard]] const char* GetTrafficClassName(TrafficClass trafficClass) noexcept;
+
+// The datagrams are spread over the classes in turn: the datagram with sequence number s belongs to
+// classes[s % classes.size()]. Prints the losses and the latency percentiles of each class, on each interface and on
+// the combined interfaces.
+void PrintTrafficClassStatistics(const LatencyData& data, const std::vector<TrafficClass>& classes);
+
+} // namespace multipath